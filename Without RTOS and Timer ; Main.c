@@ -1,74 +1,269 @@
 #include "main.h"
 #include "usart.h"
 #include "gpio.h"
-#include <string.h>
-#include <stdio.h>
-
-#define RX_BUFFER_SIZE 256
 
+#include "packet_codec.h"
+#include "crc32.h"
+#include "conflict.h"
+#include "log_ring.h"
+#include "perf.h"
+
+/*
+ * Bare-metal controller: a run-to-completion event loop. The USART1 RX
+ * interrupt only frames bytes; the loop verifies and decodes a finished
+ * frame, steps stages against absolute HAL_GetTick deadlines, and sleeps
+ * in WFI in between. Logging goes through log_ring.c (built with
+ * LOG_BARE_METAL), so nothing here waits on a UART.
+ */
+
+#ifndef CONTROLLER_ADDRESS
+#define CONTROLLER_ADDRESS 0x01
+#endif
+#ifndef CONTROLLER_GROUPS
+#define CONTROLLER_GROUPS 0x0001
+#endif
+
+/* The parser fills one buffer while the loop decodes the other. A frame
+ * that completes before the loop has taken the previous one is dropped. */
 static uint8_t  rxByte;
-static uint8_t  rxBuffer[RX_BUFFER_SIZE];
-static uint16_t rxIndex = 0;
-static volatile uint8_t packetReady = 0;
-
-static volatile uint8_t  gScheduleValid = 0;
-static uint8_t  gStageNum = 0;
-static uint32_t gStageTimes_ms[8] = {0};
-static uint32_t gStagesPattern[8] = {0};
+static PacketCodec_t rxCodec;
+static uint8_t  rxFrames[2][PACKET_MAX_FRAME];
+static uint8_t  rxParseIdx = 0;
+static volatile uint8_t  rxReadyIdx;
+static volatile uint16_t rxReadyLen = 0;
+static volatile uint32_t rxReadyStamp;
+static volatile uint32_t rxDropped = 0;
+
+static uint32_t pktLatencyLastCycles = 0;
+static uint32_t pktLatencyMaxCycles = 0;
+
+#define SIGNAL_COUNT      12
+#define SIGNAL_PORT_COUNT 2
+
+/* Clearance into a new schedule whose stage 1 may not follow the lit
+ * stage, as the FreeRTOS build's preemption clearance. */
+#ifndef CLEARANCE_YELLOW_MS
+#define CLEARANCE_YELLOW_MS  3000u
+#endif
+#ifndef CLEARANCE_ALL_RED_MS
+#define CLEARANCE_ALL_RED_MS 2000u
+#endif
+
+/* A decoded schedule with per-stage BSRR words, compiled once when the
+ * packet is accepted. */
+typedef struct
+{
+  uint8_t  stageNum;
+  uint32_t times_ms[PACKET_MAX_STAGES];
+  uint32_t patterns[PACKET_MAX_STAGES];
+  uint32_t bsrr[PACKET_MAX_STAGES][SIGNAL_PORT_COUNT];
+} BareSchedule_t;
+
+/* The loop runs gSchedules[gLive]; ProcessPacket fills the other slot and
+ * the loop swaps it in when the cycle wraps to stage 1, as the FreeRTOS
+ * build adopts schedules at a cycle start. */
+static BareSchedule_t gSchedules[2];
+static uint8_t  gLive = 0;
+static uint8_t  gPendingValid = 0;
+static uint8_t  gScheduleValid = 0;
 static uint8_t  gCurrentStageIdx = 0;
+static uint32_t gStageDeadline = 0;
+
+/* Set while a clearance step is lit. gClearSteps are still to come: 2
+ * yellow then all red, 1 all red. gClearFrom is the pattern lit. */
+static uint8_t  gClearing = 0;
+static uint8_t  gClearSteps = 0;
+static uint32_t gClearFrom = 0;
+
+typedef struct
+{
+  uint8_t  portIdx;
+  uint16_t pin;
+} SignalPin_t;
+
+/* Entry 0 is pattern bit 11, entry 11 is bit 0. PA2/PA3 carry USART2. */
+static GPIO_TypeDef * const signalPorts[SIGNAL_PORT_COUNT] = { GPIOA, GPIOB };
+static const SignalPin_t signalPins[SIGNAL_COUNT] = {
+  { 0, GPIO_PIN_0 },  { 0, GPIO_PIN_1 },  { 0, GPIO_PIN_4 },
+  { 0, GPIO_PIN_5 },  { 0, GPIO_PIN_6 },  { 0, GPIO_PIN_7 },
+  { 1, GPIO_PIN_10 }, { 1, GPIO_PIN_11 }, { 1, GPIO_PIN_12 },
+  { 1, GPIO_PIN_13 }, { 1, GPIO_PIN_14 }, { 1, GPIO_PIN_15 }
+};
 
 void SystemClock_Config(void);
-void ProcessPacket(void);
-uint32_t bytes_to_uint32(uint8_t *data);
+void ProcessPacket(const PacketSchedule_t *pkt);
+static void HandleFrame(void);
+static void StartStage(uint8_t idx);
+static int StartClearanceStep(void);
+static void NextStage(void);
+static uint32_t ClearancePattern(uint32_t from, uint32_t to, int allRed);
 static void LED_Pins_Init(void);
-static void ApplyStageToLEDs(uint32_t stagePattern);
+static void CompileStageOutput(uint32_t stagePattern, uint32_t bsrr[SIGNAL_PORT_COUNT]);
+static void ApplyStageToLEDs(const uint32_t bsrr[SIGNAL_PORT_COUNT]);
 
 
 int main(void)
 {
   HAL_Init();
   SystemClock_Config();
+  Perf_Init();
 
   MX_GPIO_Init();
   LED_Pins_Init();
   MX_USART1_UART_Init();
   MX_USART2_UART_Init();
 
-  const char *banner = "\r\nSTM32 Traffic Light Packet Decoder + LED Controller\r\n";
-  HAL_UART_Transmit(&huart2, (uint8_t*)banner, strlen(banner), HAL_MAX_DELAY);
+  Log_Init(&huart2);
+  LOG_EVENT0(LOG_TOK_BANNER);
 
+  Crc32_Init();
+  Conflict_Init();
+  PacketCodec_Init(&rxCodec, CONTROLLER_ADDRESS, CONTROLLER_GROUPS);
+  PacketCodec_SetBuffer(&rxCodec, rxFrames[rxParseIdx]);
   HAL_UART_Receive_IT(&huart1, &rxByte, 1);
 
   while (1)
   {
+    if (rxReadyLen != 0)
+    {
+      HandleFrame();
+    }
 
-    if (packetReady)
+    if (gScheduleValid && (int32_t)(HAL_GetTick() - gStageDeadline) >= 0)
     {
-      packetReady = 0;
-      ProcessPacket();
-      rxIndex = 0;
-      memset(rxBuffer, 0, RX_BUFFER_SIZE);
-      HAL_UART_Receive_IT(&huart1, &rxByte, 1);
+      NextStage();
     }
 
-    if (gScheduleValid && gStageNum > 0)
+    /* WFI still wakes on an interrupt that is pending while PRIMASK is
+     * set, so a frame finishing between the checks above and the sleep is
+     * not missed; SysTick wakes the loop for the next deadline. */
+    __disable_irq();
+    if (rxReadyLen == 0)
+      __WFI();
+    __enable_irq();
+  }
+}
+
+
+/* Drives the current stage and sets its deadline one stage time after the
+ * previous one, so late loop passes do not accumulate drift. */
+static void StartStage(uint8_t idx)
+{
+  const BareSchedule_t *s = &gSchedules[gLive];
+  gCurrentStageIdx = idx;
+  ApplyStageToLEDs(s->bsrr[idx]);
+  gStageDeadline += s->times_ms[idx];
+  LOG_EVENT(LOG_TOK_RUNNING_STAGE, (uint32_t)(idx + 1), s->times_ms[idx]);
+}
+
+/* Lights the next clearance step, skipping one that changes nothing, and
+ * returns 0 once there is none left. */
+static int StartClearanceStep(void)
+{
+  while (gClearSteps != 0)
+  {
+    int allRed = (gClearSteps == 1);
+    uint32_t pattern = ClearancePattern(gClearFrom, gSchedules[gLive].patterns[0], allRed);
+    gClearSteps--;
+    if (pattern == gClearFrom)
+      continue;
+
+    uint32_t bsrr[SIGNAL_PORT_COUNT];
+    CompileStageOutput(pattern, bsrr);
+    ApplyStageToLEDs(bsrr);
+    gClearFrom = pattern;
+    gStageDeadline += allRed ? CLEARANCE_ALL_RED_MS : CLEARANCE_YELLOW_MS;
+    return 1;
+  }
+  return 0;
+}
+
+/* Moves on at a stage deadline. At the cycle wrap a staged schedule takes
+ * over; its own check covered its own stage changes only, so the change
+ * into its stage 1 from the stage still lit is checked here and, if not
+ * allowed, cleared through yellow and all red first. */
+static void NextStage(void)
+{
+  if (gClearing)
+  {
+    if (!StartClearanceStep())
     {
-      char msg[64];
-      sprintf(msg, "Running Stage %d, delay = %.2f s\r\n", gCurrentStageIdx + 1, (float)gStageTimes_ms[gCurrentStageIdx]/1000.0f);
-      HAL_UART_Transmit(&huart2, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+      gClearing = 0;
+      StartStage(0);
+    }
+    return;
+  }
 
-      ApplyStageToLEDs(gStagesPattern[gCurrentStageIdx]);
-      HAL_Delay(gStageTimes_ms[gCurrentStageIdx]);
+  uint8_t next = (uint8_t)(gCurrentStageIdx + 1);
+  if (next >= gSchedules[gLive].stageNum)
+    next = 0;
 
-      gCurrentStageIdx++;
-      if (gCurrentStageIdx >= gStageNum)
-        gCurrentStageIdx = 0;
+  if (next == 0 && gPendingValid)
+  {
+    uint32_t showing = gSchedules[gLive].patterns[gCurrentStageIdx];
+    uint16_t signals;
+    gLive ^= 1;
+    gPendingValid = 0;
+    if (!Conflict_CheckChange(showing, gSchedules[gLive].patterns[0], &signals))
+    {
+      LOG_EVENT(LOG_TOK_ADOPT_CLEARANCE, signals);
+      gClearFrom = showing;
+      gClearSteps = 2;
+      gClearing = StartClearanceStep();
+      if (gClearing)
+        return;
     }
-    else
+  }
+  StartStage(next);
+}
+
+static void HandleFrame(void)
+{
+  const uint8_t *frame = rxFrames[rxReadyIdx];
+  uint16_t len = rxReadyLen;
+  uint32_t stamp = rxReadyStamp;
+  PacketSchedule_t pkt;
+  ConflictFault_t fault;
+
+  if (!PacketCodec_Verify(frame, len))
+  {
+    LOG_EVENT0(LOG_TOK_PKT_CRC_MISMATCH);
+  }
+  else
+  {
+    const uint8_t *payload = &frame[PACKET_HEADER_LEN];
+    uint16_t payloadLen = (uint16_t)(len - PACKET_HEADER_LEN - PACKET_CRC_LEN);
+    switch (PacketCodec_Type(payload, payloadLen))
     {
-      HAL_Delay(10);
+    case PACKET_TYPE_LEGACY:
+    case PACKET_TYPE_COMPACT:
+      if (!PacketCodec_Decode(payload, payloadLen, &pkt))
+      {
+        LOG_EVENT0(LOG_TOK_PKT_TRUNCATED);
+      }
+      else if (!Conflict_CheckSchedule(pkt.stages, pkt.stageNum, &fault))
+      {
+        LOG_EVENT(fault.kind == CONFLICT_DARK ? LOG_TOK_PKT_DARK :
+                  fault.kind == CONFLICT_CHANGE ? LOG_TOK_PKT_CONFLICT_CHANGE : LOG_TOK_PKT_CONFLICT,
+                  (uint32_t)(fault.stage + 1), fault.signals);
+      }
+      else
+      {
+        uint32_t cycles = Perf_Now() - stamp;
+        pktLatencyLastCycles = cycles;
+        if (cycles > pktLatencyMaxCycles)
+          pktLatencyMaxCycles = cycles;
+        ProcessPacket(&pkt);
+      }
+      break;
+
+    default:
+      break;
     }
   }
+
+  /* Hand the buffer back only after the decode: the ISR may refill it. */
+  rxReadyLen = 0;
 }
 
 
@@ -76,165 +271,160 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
 {
   if (huart->Instance == USART1)
   {
-    if (rxIndex < RX_BUFFER_SIZE)
+    if (PacketCodec_PushByte(&rxCodec, rxByte) == PACKET_FRAME)
     {
-      rxBuffer[rxIndex++] = rxByte;
-
-      if (rxIndex >= 3)
+      if (rxReadyLen != 0)
+      {
+        rxDropped++;
+      }
+      else
       {
-        if (rxBuffer[rxIndex - 3] == 0x45 && rxBuffer[rxIndex - 2] == 0x4F && rxBuffer[rxIndex - 1] == 0x46)
-        {
-          packetReady = 1;
-        }
+        rxReadyIdx = rxParseIdx;
+        rxReadyStamp = Perf_Now();
+        rxReadyLen = PacketCodec_FrameLen(&rxCodec);
+        rxParseIdx ^= 1;
+        PacketCodec_SetBuffer(&rxCodec, rxFrames[rxParseIdx]);
       }
     }
     HAL_UART_Receive_IT(&huart1, &rxByte, 1);
   }
 }
 
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+  Log_TxCpltHandler(huart);
+}
 
-uint32_t bytes_to_uint32(uint8_t *data)
+/* An overrun or framing error aborts the receive; re-arm it. */
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
 {
-  uint32_t value = 0;
-  value |= ((uint32_t)data[0] << 24);
-  value |= ((uint32_t)data[1] << 16);
-  value |= ((uint32_t)data[2] << 8);
-  value |= ((uint32_t)data[3]);
-  return value;
+  if (huart->Instance == USART1)
+  {
+    HAL_UART_Receive_IT(&huart1, &rxByte, 1);
+  }
 }
 
 static void LED_Pins_Init(void)
 {
   __HAL_RCC_GPIOA_CLK_ENABLE();
+  __HAL_RCC_GPIOB_CLK_ENABLE();
 
-  GPIO_InitTypeDef GPIO_InitStruct = {0};
-  GPIO_InitStruct.Pin = GPIO_PIN_0 | GPIO_PIN_1 | GPIO_PIN_4 | GPIO_PIN_5 | GPIO_PIN_6 | GPIO_PIN_7;
-  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
-  GPIO_InitStruct.Pull = GPIO_NOPULL;
-  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-  HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+  uint32_t pins[SIGNAL_PORT_COUNT] = {0};
+  for (int i = 0; i < SIGNAL_COUNT; i++)
+  {
+    pins[signalPins[i].portIdx] |= signalPins[i].pin;
+  }
 
-  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_0 | GPIO_PIN_1 | GPIO_PIN_4 | GPIO_PIN_5 | GPIO_PIN_6 | GPIO_PIN_7, GPIO_PIN_RESET);
+  for (int p = 0; p < SIGNAL_PORT_COUNT; p++)
+  {
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    GPIO_InitStruct.Pin = pins[p];
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    HAL_GPIO_Init(signalPorts[p], &GPIO_InitStruct);
+
+    WRITE_REG(signalPorts[p]->BSRR, pins[p] << 16);
+  }
 }
 
-static void ApplyStageToLEDs(uint32_t stagePattern)
+static void CompileStageOutput(uint32_t stagePattern, uint32_t bsrr[SIGNAL_PORT_COUNT])
 {
-  uint8_t b0 = (stagePattern >> 11) & 0x1;
-  uint8_t b1 = (stagePattern >> 10) & 0x1;
-  uint8_t b2 = (stagePattern >> 9 ) & 0x1;
-  uint8_t b3 = (stagePattern >> 8 ) & 0x1;
-  uint8_t b4 = (stagePattern >> 7 ) & 0x1;
-  uint8_t b5 = (stagePattern >> 6 ) & 0x1;
-
-  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_0, b0 ? GPIO_PIN_SET : GPIO_PIN_RESET);
-  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_1, b1 ? GPIO_PIN_SET : GPIO_PIN_RESET);
-  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_4, b2 ? GPIO_PIN_SET : GPIO_PIN_RESET);
-  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_5, b3 ? GPIO_PIN_SET : GPIO_PIN_RESET);
-  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_6, b4 ? GPIO_PIN_SET : GPIO_PIN_RESET);
-  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_7, b5 ? GPIO_PIN_SET : GPIO_PIN_RESET);
-}
+  for (int p = 0; p < SIGNAL_PORT_COUNT; p++)
+  {
+    bsrr[p] = 0;
+  }
 
+  for (int i = 0; i < SIGNAL_COUNT; i++)
+  {
+    const SignalPin_t *sp = &signalPins[i];
+    if ((stagePattern >> (SIGNAL_COUNT - 1 - i)) & 0x1)
+      bsrr[sp->portIdx] |= sp->pin;
+    else
+      bsrr[sp->portIdx] |= (uint32_t)sp->pin << 16;
+  }
+}
 
-void ProcessPacket(void)
+static void ApplyStageToLEDs(const uint32_t bsrr[SIGNAL_PORT_COUNT])
 {
-  char msg[256];
-  uint16_t idx = 0;
-
-
-  for (uint16_t i = 0; i + 2 < rxIndex; i++)
+  for (int p = 0; p < SIGNAL_PORT_COUNT; p++)
   {
-    if (rxBuffer[i] == 0x53 && rxBuffer[i + 1] == 0x4F && rxBuffer[i + 2] == 0x46)
-    {
-      idx = i + 3;
-      break;
-    }
+    WRITE_REG(signalPorts[p]->BSRR, bsrr[p]);
   }
+}
 
-  if (idx == 0)
+/* One clearance step, as main.c's: pattern bits 11-3a, 10-3a and 9-3a are
+ * the red, yellow and green heads of approach a. A green in both keeps
+ * its green; one losing its green shows yellow, or red once allRed is
+ * set; the rest hold during the yellow step and show red after it. */
+static uint32_t ClearancePattern(uint32_t from, uint32_t to, int allRed)
+{
+  uint32_t out = 0;
+  for (int a = 0; a < CONFLICT_APPROACHES; a++)
   {
-    const char *err = "No SOF found\r\n";
-    HAL_UART_Transmit(&huart2, (uint8_t*)err, strlen(err), HAL_MAX_DELAY);
-    return;
+    uint32_t red = 1u << (11 - 3 * a);
+    uint32_t yellow = 1u << (10 - 3 * a);
+    uint32_t green = 1u << (9 - 3 * a);
+
+    if ((from & green) && (to & green))
+      out |= green;
+    else if (allRed)
+      out |= red;
+    else if (from & green)
+      out |= yellow;
+    else
+      out |= from & (red | yellow | green);
   }
+  return out;
+}
 
-  uint16_t length = (rxBuffer[idx] << 8) | rxBuffer[idx + 1];
-  idx += 2;
 
-  uint8_t StageNum = rxBuffer[idx++];
-  uint8_t MaxLight = rxBuffer[idx++];
+void ProcessPacket(const PacketSchedule_t *pkt)
+{
+  int shown = (pkt->stageNum > PACKET_LEGACY_STAGES) ? pkt->stageNum : PACKET_LEGACY_STAGES;
 
-  uint32_t StageTimes_raw[8] = {0};
-  for (int i = 0; i < 8; i++)
+  LOG_EVENT0(LOG_TOK_PKT_HEADER);
+  LOG_EVENT(LOG_TOK_PKT_STAGE_NUM, pkt->stageNum);
+  LOG_EVENT(LOG_TOK_PKT_MAX_LIGHT, pkt->maxLight);
+  Log_Event(LOG_TOK_PKT_STAGE_TIMES, pkt->stageTimes_ms, PACKET_LEGACY_STAGES);
+  for (int i = PACKET_LEGACY_STAGES; i < shown; i++)
   {
-    StageTimes_raw[i] = bytes_to_uint32(&rxBuffer[idx]);
-    idx += 4;
+    LOG_EVENT(LOG_TOK_PKT_STAGE_TIME, (uint32_t)(i + 1), pkt->stageTimes_ms[i]);
   }
 
-  uint32_t Stages[8] = {0};
-  for (int i = 0; i < 8; i++)
+  LOG_EVENT0(LOG_TOK_PKT_STAGES_HDR);
+  for (int i = 0; i < shown; i++)
   {
-    Stages[i] = bytes_to_uint32(&rxBuffer[idx]);
-    idx += 4;
+    LOG_EVENT(LOG_TOK_PKT_STAGE, (uint32_t)(i + 1), pkt->stages[i]);
   }
 
-  uint8_t green_Ext = rxBuffer[idx++];
-  uint8_t Interrupt = rxBuffer[idx++];
-
-
-  sprintf(msg, "\r\nNEW PACKET RECEIVED\r\n");
-  HAL_UART_Transmit(&huart2, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+  LOG_EVENT(LOG_TOK_PKT_FLAGS, pkt->greenExt, pkt->interrupt);
+  LOG_EVENT(LOG_TOK_PKT_LATENCY, Perf_CyclesToUs(pktLatencyLastCycles), Perf_CyclesToUs(pktLatencyMaxCycles));
 
-  sprintf(msg, "StageNum = %d\r\n", StageNum);
-  HAL_UART_Transmit(&huart2, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
-
-  sprintf(msg, "MaxLight = %d\r\n", MaxLight);
-  HAL_UART_Transmit(&huart2, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
-
-  sprintf(msg, "StageTimes = [");
-  HAL_UART_Transmit(&huart2, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
-  for (int i = 0; i < 8; i++)
+  /* Staged in the spare slot: the running cycle finishes on the old
+   * schedule, and NextStage swaps this one in when it wraps. A newer
+   * packet before then replaces it. */
+  BareSchedule_t *s = &gSchedules[gScheduleValid ? gLive ^ 1 : gLive];
+  s->stageNum = pkt->stageNum;
+  for (int i = 0; i < pkt->stageNum; i++)
   {
-    float t = (float)StageTimes_raw[i] / 1000.0f;
-    sprintf(msg, "%.2f", t);
-    HAL_UART_Transmit(&huart2, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
-    sprintf(msg, (i < 7) ? ", " : "]\r\n");
-    HAL_UART_Transmit(&huart2, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+    s->patterns[i] = pkt->stages[i];
+    CompileStageOutput(pkt->stages[i], s->bsrr[i]);
+    uint32_t ms = pkt->stageTimes_ms[i];
+    if (ms == 0) ms = 1;
+    s->times_ms[i] = ms;
   }
 
-
-  sprintf(msg, "\r\nStages:\r\n");
-  HAL_UART_Transmit(&huart2, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
-  for (int i = 0; i < 8; i++)
+  if (!gScheduleValid)
   {
-    sprintf(msg, "Stage %d: [", i + 1);
-    HAL_UART_Transmit(&huart2, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
-    for (int bit = 11; bit >= 0; bit--)
-    {
-      uint8_t val = (Stages[i] >> bit) & 0x01;
-      sprintf(msg, "%d", val);
-      HAL_UART_Transmit(&huart2, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
-      if (bit != 0) {
-        sprintf(msg, ", ");
-        HAL_UART_Transmit(&huart2, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
-      }
-    }
-    sprintf(msg, "]\r\n");
-    HAL_UART_Transmit(&huart2, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+    gScheduleValid = 1;
+    gStageDeadline = HAL_GetTick();
+    StartStage(0);
   }
-
-  sprintf(msg, "green_Ext = %d\r\nInterrupt = %d\r\n\r\n", green_Ext, Interrupt);
-  HAL_UART_Transmit(&huart2, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
-
-
-  gStageNum = StageNum;
-  for (int i = 0; i < 8; i++)
+  else
   {
-    gStagesPattern[i] = Stages[i];
-    uint32_t ms = StageTimes_raw[i];
-    if (ms == 0) ms = 1;
-    gStageTimes_ms[i] = ms;
+    gPendingValid = 1;
   }
-  gScheduleValid = 1;
 }
 
 
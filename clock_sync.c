@@ -0,0 +1,48 @@
+#include "clock_sync.h"
+
+typedef struct
+{
+    uint32_t refLocalMs;
+    int64_t  sharedAtRefMs;
+    int32_t  driftPpb;
+} ClockModel_t;
+
+static ClockModel_t model;
+static uint32_t modelSeq = 0;   /* odd while the writer is updating model */
+
+void ClockSync_Set(uint32_t refLocalMs, int64_t sharedAtRefMs, int32_t driftPpb)
+{
+    __atomic_add_fetch(&modelSeq, 1u, __ATOMIC_ACQ_REL);
+    model.refLocalMs = refLocalMs;
+    model.sharedAtRefMs = sharedAtRefMs;
+    model.driftPpb = driftPpb;
+    __atomic_add_fetch(&modelSeq, 1u, __ATOMIC_ACQ_REL);
+}
+
+int ClockSync_Valid(void)
+{
+    return __atomic_load_n(&modelSeq, __ATOMIC_ACQUIRE) != 0;
+}
+
+uint32_t ClockSync_SetCount(void)
+{
+    return __atomic_load_n(&modelSeq, __ATOMIC_ACQUIRE) / 2u;
+}
+
+int64_t ClockSync_SharedMs(uint32_t localMs)
+{
+    ClockModel_t m;
+    uint32_t seq;
+
+    do
+    {
+        seq = __atomic_load_n(&modelSeq, __ATOMIC_ACQUIRE);
+        m = model;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1u) || seq != __atomic_load_n(&modelSeq, __ATOMIC_RELAXED));
+
+    if (seq == 0) return localMs;
+
+    int64_t since = (int32_t)(localMs - m.refLocalMs);
+    return m.sharedAtRefMs + since + since * m.driftPpb / 1000000000;
+}
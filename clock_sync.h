@@ -0,0 +1,30 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdint.h>
+
+/*
+ * Shared time for coordinating neighbouring controllers: the Pi's clock,
+ * as Unix time in ms. The Pi measures each controller's offset and drift
+ * with PACKET_TIME_PING exchanges and sends the result in a
+ * PACKET_TIME_SET; from then on
+ *
+ *   shared = sharedAtRef + (local - ref) * (1 + drift_ppb / 10^9)
+ *
+ * where local is the controller's tick clock in ms (wrapping u32) and ref
+ * a local time the Pi picked from a recent exchange. One writer (the packet
+ * task) and any number of readers; readers never block and retry if a set
+ * lands while they read.
+ */
+void ClockSync_Set(uint32_t refLocalMs, int64_t sharedAtRefMs, int32_t driftPpb);
+
+/* 0 until the first ClockSync_Set. */
+int ClockSync_Valid(void);
+
+/* Shared time at local time localMs; localMs must be within about 24 days
+ * of the last set's reference. Returns localMs when not synchronised. */
+int64_t ClockSync_SharedMs(uint32_t localMs);
+
+uint32_t ClockSync_SetCount(void);
+
+#endif
@@ -0,0 +1,187 @@
+#include "conflict.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "packet_codec.h"
+
+#define RED(a)       (1u << (11 - 3 * (a)))
+#define YELLOW(a)    (1u << (10 - 3 * (a)))
+#define GREEN(a)     (1u << (9 - 3 * (a)))
+#define SIGNAL_MASK  ((1u << CONFLICT_SIGNALS) - 1u)
+#define GREENS       (GREEN(0) | GREEN(1) | GREEN(2) | GREEN(3))
+
+/* Row s: signals that may not be lit with signal s, and that may not be
+ * lit in the stage after one showing s. */
+static uint16_t together[CONFLICT_SIGNALS];
+static uint16_t after[CONFLICT_SIGNALS];
+
+typedef struct
+{
+    uint8_t  stageNum;
+    uint8_t  ok;
+    ConflictFault_t fault;
+    uint16_t patterns[PACKET_MAX_STAGES];
+} ConflictVerdict_t;
+
+static ConflictVerdict_t cache[CONFLICT_CACHE_LEN];
+static uint8_t cacheNext = 0;
+
+static uint32_t rejected = 0;
+static uint32_t cacheHits = 0;
+
+static void Forbid(uint16_t *matrix, uint32_t lit, uint32_t others)
+{
+    for (int s = 0; s < CONFLICT_SIGNALS; s++)
+    {
+        if (lit & (1u << s)) matrix[s] |= (uint16_t)others;
+    }
+}
+
+void Conflict_Init(void)
+{
+    static const uint8_t approachConflicts[CONFLICT_APPROACHES] = CONFLICT_APPROACH_MATRIX;
+
+    memset(together, 0, sizeof(together));
+    memset(after, 0, sizeof(after));
+    memset(cache, 0, sizeof(cache));
+
+    for (int a = 0; a < CONFLICT_APPROACHES; a++)
+    {
+        Forbid(together, RED(a), YELLOW(a) | GREEN(a));
+        Forbid(together, YELLOW(a), RED(a) | GREEN(a));
+        Forbid(together, GREEN(a), RED(a) | YELLOW(a));
+        Forbid(after, GREEN(a), RED(a));
+        Forbid(after, YELLOW(a), GREEN(a));
+
+        for (int b = 0; b < CONFLICT_APPROACHES; b++)
+        {
+            if (b == a || !((approachConflicts[a] >> b) & 1u)) continue;
+            Forbid(together, YELLOW(a) | GREEN(a), YELLOW(b) | GREEN(b));
+            Forbid(together, YELLOW(b) | GREEN(b), YELLOW(a) | GREEN(a));
+            Forbid(after, GREEN(a), GREEN(b));
+            Forbid(after, GREEN(b), GREEN(a));
+        }
+    }
+}
+
+/* Signals of lit whose row meets other, together with the ones they meet.
+ * One AND per lit signal. */
+static uint16_t Offending(const uint16_t *matrix, uint32_t lit, uint32_t other)
+{
+    uint32_t bad = 0;
+    for (uint32_t m = lit; m != 0; m &= m - 1u)
+    {
+        int s = __builtin_ctz(m);
+        uint32_t hit = matrix[s] & other;
+        if (hit) bad |= (1u << s) | hit;
+    }
+    return (uint16_t)bad;
+}
+
+/* All three heads of every approach that shows none. */
+static uint16_t Dark(uint32_t pattern)
+{
+    uint32_t dark = GREENS & ~(pattern | (pattern >> 1) | (pattern >> 2));
+    return (uint16_t)(dark * 7u);
+}
+
+static uint8_t Check(const uint16_t *patterns, uint8_t stageNum, ConflictFault_t *fault)
+{
+    uint32_t prev = patterns[stageNum - 1];
+    for (uint8_t i = 0; i < stageNum; i++)
+    {
+        uint32_t cur = patterns[i];
+        uint16_t bad = Dark(cur);
+        if (bad)
+        {
+            fault->stage = i;
+            fault->kind = CONFLICT_DARK;
+            fault->signals = bad;
+            return 0;
+        }
+        bad = Offending(together, cur, cur);
+        if (bad)
+        {
+            fault->stage = i;
+            fault->kind = CONFLICT_TOGETHER;
+            fault->signals = bad;
+            return 0;
+        }
+        bad = Offending(after, prev, cur);
+        if (bad)
+        {
+            fault->stage = i;
+            fault->kind = CONFLICT_CHANGE;
+            fault->signals = bad;
+            return 0;
+        }
+        prev = cur;
+    }
+    return 1;
+}
+
+uint8_t Conflict_CheckSchedule(const uint32_t *patterns, uint8_t stageNum, ConflictFault_t *fault)
+{
+    if (stageNum == 0 || stageNum > PACKET_MAX_STAGES) return 0;
+
+    uint16_t key[PACKET_MAX_STAGES];
+    for (uint8_t i = 0; i < stageNum; i++)
+    {
+        key[i] = (uint16_t)(patterns[i] & SIGNAL_MASK);
+    }
+
+    ConflictVerdict_t *v = NULL;
+    for (int c = 0; c < CONFLICT_CACHE_LEN; c++)
+    {
+        if (cache[c].stageNum == stageNum &&
+            memcmp(cache[c].patterns, key, stageNum * sizeof(key[0])) == 0)
+        {
+            v = &cache[c];
+            cacheHits++;
+            break;
+        }
+    }
+
+    if (v == NULL)
+    {
+        v = &cache[cacheNext];
+        cacheNext = (uint8_t)((cacheNext + 1) % CONFLICT_CACHE_LEN);
+        v->ok = Check(key, stageNum, &v->fault);
+        memcpy(v->patterns, key, stageNum * sizeof(key[0]));
+        v->stageNum = stageNum;
+    }
+
+    if (!v->ok)
+    {
+        rejected++;
+        *fault = v->fault;
+    }
+    return v->ok;
+}
+
+uint8_t Conflict_CheckPattern(uint32_t pattern, uint16_t *signals, uint8_t *kind)
+{
+    *kind = CONFLICT_DARK;
+    *signals = Dark(pattern);
+    if (*signals) return 0;
+    *kind = CONFLICT_TOGETHER;
+    *signals = Offending(together, pattern & SIGNAL_MASK, pattern & SIGNAL_MASK);
+    return *signals == 0;
+}
+
+uint8_t Conflict_CheckChange(uint32_t from, uint32_t to, uint16_t *signals)
+{
+    *signals = Offending(after, from & SIGNAL_MASK, to & SIGNAL_MASK);
+    return *signals == 0;
+}
+
+uint32_t Conflict_Rejected(void)
+{
+    return rejected;
+}
+
+uint32_t Conflict_CacheHits(void)
+{
+    return cacheHits;
+}
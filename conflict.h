@@ -0,0 +1,75 @@
+#ifndef CONFLICT_H
+#define CONFLICT_H
+
+#include <stdint.h>
+
+/*
+ * Conflict monitor. Pattern bits 11-3a, 10-3a and 9-3a are the red, yellow
+ * and green heads of approach a (main.c's approachHeads). Conflict_Init
+ * expands a per-approach conflict table into two per-signal bitmask
+ * matrices: signals that may not be lit together in one stage, and
+ * signals that may not be lit in the stage right after one that was lit.
+ * Every stage and every stage change of a schedule, including last back
+ * to first, is checked once when the frame is decoded; the LED controller
+ * only ever runs schedules that passed, so a stage change costs nothing.
+ * The change into a newly adopted schedule is checked when it is adopted.
+ *
+ * Rules: one head per approach, and never none; conflicting approaches never show green or
+ * yellow together; a green goes to yellow, not straight to red; a yellow
+ * does not go back to green; and an approach does not turn green straight
+ * after a conflicting green (a yellow stage must come between).
+ */
+
+#define CONFLICT_SIGNALS    12
+#define CONFLICT_APPROACHES 4
+
+/* Bit b of entry a: approaches a and b must not move at the same time.
+ * The default keeps every approach apart, as the sample schedule runs
+ * them. Override per intersection with a braced initializer. */
+#ifndef CONFLICT_APPROACH_MATRIX
+#define CONFLICT_APPROACH_MATRIX { 0xE, 0xD, 0xB, 0x7 }
+#endif
+
+/* Verdicts of recently checked pattern sequences. A schedule resent with
+ * new times only, or alternating between a few plans, is looked up
+ * instead of re-checked. */
+#ifndef CONFLICT_CACHE_LEN
+#define CONFLICT_CACHE_LEN 2
+#endif
+
+typedef enum
+{
+    CONFLICT_TOGETHER = 0,  /* signals lit together in one stage             */
+    CONFLICT_CHANGE,        /* the change into stage from the one before     */
+    CONFLICT_DARK           /* approaches with no head lit                   */
+} ConflictKind_t;
+
+typedef struct
+{
+    uint8_t  stage;         /* index of the offending stage                 */
+    uint8_t  kind;          /* ConflictKind_t                               */
+    uint16_t signals;       /* pattern bits in conflict, or the heads of the
+                               dark approaches                              */
+} ConflictFault_t;
+
+void Conflict_Init(void);
+
+/* Returns 1 when every stage and stage change of patterns[0..stageNum-1]
+ * is allowed; otherwise 0, with the first offence in *fault. */
+uint8_t Conflict_CheckSchedule(const uint32_t *patterns, uint8_t stageNum, ConflictFault_t *fault);
+
+/* One pattern on its own, without the cache: safe to call from any task
+ * while the packet task checks schedules. Used for preemption patterns.
+ * Returns 0 with *kind CONFLICT_TOGETHER or CONFLICT_DARK on failure. */
+uint8_t Conflict_CheckPattern(uint32_t pattern, uint16_t *signals, uint8_t *kind);
+
+/* The change from one lit pattern to another, without the cache: for the
+ * change from whatever is showing to the first stage of a schedule taken
+ * over at run time, which no schedule check can see. Returns 0 with the
+ * offending signals in *signals. */
+uint8_t Conflict_CheckChange(uint32_t from, uint32_t to, uint16_t *signals);
+
+uint32_t Conflict_Rejected(void);
+uint32_t Conflict_CacheHits(void);
+
+#endif
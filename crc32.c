@@ -0,0 +1,52 @@
+#include "crc32.h"
+
+#if defined(STM32F407xx) && !defined(CRC32_FORCE_SOFTWARE)
+#define CRC32_USE_HW 1
+#include "main.h"
+#else
+#define CRC32_USE_HW 0
+#endif
+
+/* Slice-by-4 tables, const so they stay in flash rather than taking 4 KB
+ * of RAM; crc32_table.h is generated by host/gen_crc32_table.py. */
+#include "crc32_table.h"
+
+void Crc32_Init(void)
+{
+#if CRC32_USE_HW
+    __HAL_RCC_CRC_CLK_ENABLE();
+#endif
+}
+
+uint32_t Crc32_Update(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+    while (len >= 4)
+    {
+        crc ^= ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | (uint32_t)data[3];
+        crc = crcTable[3][crc >> 24] ^ crcTable[2][(crc >> 16) & 0xFF] ^
+              crcTable[1][(crc >> 8) & 0xFF] ^ crcTable[0][crc & 0xFF];
+        data += 4;
+        len -= 4;
+    }
+    while (len--)
+    {
+        crc = (crc << 8) ^ crcTable[0][(crc >> 24) ^ *data++];
+    }
+    return crc;
+}
+
+uint32_t Crc32_Compute(const uint8_t *data, uint32_t len)
+{
+#if CRC32_USE_HW
+    CRC->CR = CRC_CR_RESET;
+    while (len >= 4)
+    {
+        CRC->DR = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | (uint32_t)data[3];
+        data += 4;
+        len -= 4;
+    }
+    return Crc32_Update(CRC->DR, data, len);
+#else
+    return Crc32_Update(CRC32_INIT, data, len);
+#endif
+}
@@ -0,0 +1,24 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+
+/*
+ * CRC-32/MPEG-2 (poly 0x04C11DB7, init 0xFFFFFFFF, no reflection, no final
+ * xor), the algorithm implemented by the STM32 CRC peripheral when it is fed
+ * big-endian words. On the STM32F407 build Crc32_Compute runs on that unit;
+ * everywhere else it falls back to a slice-by-4 table implementation.
+ */
+
+#define CRC32_INIT 0xFFFFFFFFu
+
+void Crc32_Init(void);
+
+/* Software CRC continuing from crc; usable from any context. */
+uint32_t Crc32_Update(uint32_t crc, const uint8_t *data, uint32_t len);
+
+/* CRC of a whole buffer. The hardware path is not reentrant: call it from
+ * one task only. */
+uint32_t Crc32_Compute(const uint8_t *data, uint32_t len);
+
+#endif
@@ -0,0 +1,186 @@
+#include "flash_ram.h"
+
+#include <stddef.h>
+
+static void (*beginHook)(void) = NULL;
+static void (*endHook)(uint32_t ticks) = NULL;
+
+void FlashRam_SetHooks(void (*begin)(void), void (*end)(uint32_t ticks))
+{
+    beginHook = begin;
+    endHook = end;
+}
+
+#if defined(HOST_SIM)
+
+/* The simulation's flash is a file; nothing stalls, so nothing moves. */
+void FlashRam_Init(void)
+{
+}
+
+int FlashRam_AddIrq(IRQn_Type irq, void (*handler)(void))
+{
+    (void) irq;
+    (void) handler;
+    return 1;
+}
+
+int FlashRam_EraseSector(uint32_t sector)
+{
+    FLASH_EraseInitTypeDef erase = {0};
+    uint32_t badSector = 0;
+    erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+    erase.Sector = sector;
+    erase.NbSectors = 1;
+    erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+
+    if (beginHook != NULL) beginHook();
+    HAL_StatusTypeDef st = HAL_FLASHEx_Erase(&erase, &badSector);
+    if (endHook != NULL) endHook(0);
+    return st == HAL_OK;
+}
+
+#else
+
+/* 16 system exceptions and the F407's 82 interrupts; VTOR needs the table
+ * aligned to its size rounded up to a power of two. */
+#define VECTOR_COUNT   (16 + FPU_IRQn + 1)
+#define VECTOR_SYSTICK 15
+#define NVIC_WORDS     ((FPU_IRQn + 32) / 32)
+#define FLASH_ERRORS   (FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR | \
+                        FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR)
+
+static uint32_t ramVectors[VECTOR_COUNT] __attribute__((aligned(512)));
+
+typedef struct
+{
+    IRQn_Type irq;
+    void (*handler)(void);
+} FlashRamIrq_t;
+
+static FlashRamIrq_t irqs[FLASH_RAM_MAX_IRQS];
+static uint8_t irqCount = 0;
+
+static volatile uint32_t busyTicks = 0;
+
+void FlashRam_Init(void)
+{
+    const uint32_t *vectors = (const uint32_t *)(uintptr_t)SCB->VTOR;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (int i = 0; i < VECTOR_COUNT; i++)
+    {
+        ramVectors[i] = vectors[i];
+    }
+    SCB->VTOR = (uint32_t)(uintptr_t)ramVectors;
+    __DSB();
+    __ISB();
+    __set_PRIMASK(primask);
+}
+
+int FlashRam_AddIrq(IRQn_Type irq, void (*handler)(void))
+{
+    if (irqCount >= FLASH_RAM_MAX_IRQS || irq < 0) return 0;
+    irqs[irqCount].irq = irq;
+    irqs[irqCount].handler = handler;
+    irqCount++;
+    return 1;
+}
+
+static FLASH_RAMFUNC void BusySysTick(void)
+{
+    busyTicks++;
+}
+
+/* Starts the erase and waits for it without a single flash fetch; the
+ * constants sit in this function's literal pool, in RAM with it. */
+static FLASH_RAMFUNC uint32_t EraseFromRam(uint32_t cr)
+{
+    FLASH->CR = cr;
+    FLASH->CR = cr | FLASH_CR_STRT;
+    while ((FLASH->SR & FLASH_FLAG_BSY) != 0)
+    {
+    }
+    return FLASH->SR;
+}
+
+/* Fetches from the erased sector may sit in the ART caches. */
+static void FlushCaches(void)
+{
+    if (FLASH->ACR & FLASH_ACR_ICEN)
+    {
+        FLASH->ACR &= ~FLASH_ACR_ICEN;
+        FLASH->ACR |= FLASH_ACR_ICRST;
+        FLASH->ACR &= ~FLASH_ACR_ICRST;
+        FLASH->ACR |= FLASH_ACR_ICEN;
+    }
+    if (FLASH->ACR & FLASH_ACR_DCEN)
+    {
+        FLASH->ACR &= ~FLASH_ACR_DCEN;
+        FLASH->ACR |= FLASH_ACR_DCRST;
+        FLASH->ACR &= ~FLASH_ACR_DCRST;
+        FLASH->ACR |= FLASH_ACR_DCEN;
+    }
+}
+
+int FlashRam_EraseSector(uint32_t sector)
+{
+    uint32_t enabled[NVIC_WORDS];
+    uint32_t saved[FLASH_RAM_MAX_IRQS];
+    uint32_t savedSysTick;
+
+    while ((FLASH->SR & FLASH_FLAG_BSY) != 0)
+    {
+    }
+    FLASH->SR = FLASH_FLAG_EOP | FLASH_ERRORS;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (beginHook != NULL) beginHook();
+
+    /* Everything off, then the RAM-handled ones back on if they were. */
+    for (int w = 0; w < NVIC_WORDS; w++)
+    {
+        enabled[w] = NVIC->ISER[w];
+        NVIC->ICER[w] = 0xFFFFFFFFu;
+    }
+    busyTicks = 0;
+    savedSysTick = ramVectors[VECTOR_SYSTICK];
+    ramVectors[VECTOR_SYSTICK] = (uint32_t)(uintptr_t)BusySysTick;
+    for (uint8_t i = 0; i < irqCount; i++)
+    {
+        uint32_t n = (uint32_t)irqs[i].irq;
+        saved[i] = ramVectors[16 + n];
+        ramVectors[16 + n] = (uint32_t)(uintptr_t)irqs[i].handler;
+        if (enabled[n >> 5] & (1u << (n & 31u))) NVIC->ISER[n >> 5] = 1u << (n & 31u);
+    }
+    __DSB();
+    __ISB();
+    __set_PRIMASK(primask);
+
+    uint32_t sr = EraseFromRam(FLASH_CR_SER | (sector << FLASH_CR_SNB_Pos) | FLASH_PSIZE_WORD);
+
+    __disable_irq();
+    for (uint8_t i = 0; i < irqCount; i++)
+    {
+        uint32_t n = (uint32_t)irqs[i].irq;
+        NVIC->ICER[n >> 5] = 1u << (n & 31u);
+        ramVectors[16 + n] = saved[i];
+    }
+    ramVectors[VECTOR_SYSTICK] = savedSysTick;
+    __DSB();
+    __ISB();
+    for (int w = 0; w < NVIC_WORDS; w++)
+    {
+        NVIC->ISER[w] = enabled[w];
+    }
+    FLASH->CR &= ~(FLASH_CR_SER | FLASH_CR_SNB);
+    FlushCaches();
+    uint32_t ticks = busyTicks;
+    __set_PRIMASK(primask);
+
+    if (endHook != NULL) endHook(ticks);
+    return (sr & FLASH_ERRORS) == 0;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef FLASH_RAM_H
+#define FLASH_RAM_H
+
+#include <stdint.h>
+
+#include "main.h"
+
+/*
+ * Flash erase that interrupts do not wait for. On the single-bank F407 a
+ * sector erase stalls every flash fetch, vector fetches included, for up
+ * to 500 ms (16 KB sector). FlashRam_Init copies the vector table to RAM
+ * and points VTOR at the copy. For the length of an erase:
+ *
+ *   - the interrupts registered with FlashRam_AddIrq run RAM handlers
+ *     (FLASH_RAMFUNC) that touch RAM and peripheral registers only;
+ *   - SysTick is counted instead of run, so the kernel can catch up;
+ *   - every other interrupt is masked in the NVIC and stays pending;
+ *   - the erase is started and waited for from RAM.
+ *
+ * The begin hook runs just before the vectors are switched, with
+ * interrupts off; the end hook runs after everything is restored, with
+ * interrupts on, to catch the kernel up by the ticks it missed and hand
+ * over what the RAM handlers collected. Tasks do not run during the
+ * erase.
+ */
+
+#if defined(HOST_SIM)
+#define FLASH_RAMFUNC
+#else
+#define FLASH_RAMFUNC __attribute__((section(".RamFunc"), noinline, long_call))
+#endif
+
+#define FLASH_RAM_MAX_IRQS 8
+
+/* Before the first erase; interrupts may already be running. */
+void FlashRam_Init(void);
+
+/* irq keeps running from handler (FLASH_RAMFUNC) during an erase. 0 when
+ * the table is full. */
+int FlashRam_AddIrq(IRQn_Type irq, void (*handler)(void));
+
+/* end gets the number of SysTick periods the kernel missed. */
+void FlashRam_SetHooks(void (*begin)(void), void (*end)(uint32_t ticks));
+
+/* Erases sector (FLASH_SECTOR_x) of the unlocked flash. 1 on success. */
+int FlashRam_EraseSector(uint32_t sector);
+
+#endif
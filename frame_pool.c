@@ -0,0 +1,37 @@
+#include "frame_pool.h"
+
+#include <stddef.h>
+
+#define FRAME_POOL_ALL ((uint32_t)((1ull << FRAME_POOL_COUNT) - 1u))
+
+static FrameBuf_t pool[FRAME_POOL_COUNT];
+
+/* Bit i set: pool[i] is free. */
+static uint32_t freeMask = FRAME_POOL_ALL;
+static uint8_t minFree = FRAME_POOL_COUNT;
+
+FrameBuf_t *FramePool_Alloc(void)
+{
+    uint32_t mask = __atomic_load_n(&freeMask, __ATOMIC_ACQUIRE);
+    uint32_t bit;
+    do
+    {
+        if (mask == 0) return NULL;
+        bit = mask & (~mask + 1u);
+    } while (!__atomic_compare_exchange_n(&freeMask, &mask, mask & ~bit, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    uint8_t left = (uint8_t)__builtin_popcount(mask & ~bit);
+    if (left < minFree) minFree = left;
+    return &pool[__builtin_ctz(bit)];
+}
+
+void FramePool_Free(FrameBuf_t *buf)
+{
+    if (buf == NULL) return;
+    __atomic_fetch_or(&freeMask, 1u << (uint32_t)(buf - pool), __ATOMIC_RELEASE);
+}
+
+uint8_t FramePool_MinFree(void)
+{
+    return minFree;
+}
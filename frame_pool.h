@@ -0,0 +1,35 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <stdint.h>
+
+#include "packet_codec.h"
+
+/*
+ * Fixed pool of receive frame buffers. The RX ISR parses bytes straight
+ * into a buffer it owns, hands the completed frame to StartPacketProcessor
+ * by pointer and takes a fresh buffer for the next one; the packet task
+ * decodes in place and frees the buffer. A frame is never copied after
+ * the parser stores it. Alloc and Free are single atomic operations on a
+ * bitmask, so both are safe from the ISR and from tasks.
+ */
+
+#ifndef FRAME_POOL_COUNT
+#define FRAME_POOL_COUNT 4      /* one in the parser, the rest queued */
+#endif
+
+typedef struct
+{
+    uint32_t rxStamp;           /* Perf_Now() when the EOF was received */
+    uint16_t len;               /* ADDR..CRC32 bytes in frame           */
+    uint8_t  frame[PACKET_MAX_FRAME];
+} FrameBuf_t;
+
+/* NULL when every buffer is in use. */
+FrameBuf_t *FramePool_Alloc(void);
+void FramePool_Free(FrameBuf_t *buf);
+
+/* Fewest buffers that have been free at once since boot. */
+uint8_t FramePool_MinFree(void);
+
+#endif
@@ -2,329 +2,1092 @@
 #include "main.h"
 #include "usart.h"
 #include <string.h>
-#include <stdio.h>
 
 #include "FreeRTOS.h"
 #include "task.h"
-#include "timers.h"
 #include "semphr.h"
+#include "queue.h"
 
-#define RX_BUFFER_SIZE 256
+#include "perf.h"
+#include "probe.h"
+#include "packet_codec.h"
+#include "schedule.h"
+#include "conflict.h"
+#include "schedule_store.h"
+#include "frame_pool.h"
+#include "log_ring.h"
+#include "stats.h"
+#include "clock_sync.h"
+#include "power.h"
 
-extern uint8_t rxBuffer[];
-extern uint16_t rxIndex;
-extern volatile uint8_t packetReady;
-
-extern SemaphoreHandle_t xUART_Mutex;
-extern SemaphoreHandle_t xData_Mutex;
+extern QueueHandle_t xPacketQueue;
+extern osThreadId_t packetTaskHandle;
+extern osThreadId_t ledTaskHandle;
+extern osThreadId_t storeTaskHandle;
 
-extern UART_HandleTypeDef huart6;
+extern volatile uint32_t rxIsrCount;
+extern volatile uint32_t rxIsrMaxCycles;
+extern volatile uint32_t rxFramesDropped;
+extern volatile uint32_t rxFramesRejected;
+extern volatile uint32_t rxFramesFiltered;
+extern volatile uint32_t gDetectorCalls;
+extern volatile uint32_t gDetectorCallStamp;
+extern const uint8_t gControllerAddress;
 
-extern uint8_t gStageNum;
-extern uint32_t gStageTimes_ms[8];
-extern uint32_t gStagesPattern[8];
 extern volatile uint8_t gCurrentStageIdx;
-extern volatile uint8_t gScheduleValid;
 
-extern osThreadId_t ledTaskHandle;
+extern void CompileStageOutput(uint32_t pattern, StageOutput_t *out);
+extern void ApplyStageToLEDs(const StageOutput_t *out);
+extern uint8_t DetectorsForPattern(uint32_t pattern);
+extern uint32_t ClearancePattern(uint32_t from, uint32_t to, int allRed);
+extern PacketPreempt_t gPreemptRequest;
+extern uint32_t gPreemptRxStamp;
+
+/* Decoded packets for PrintStoredPacketOnce. The packet task decodes into
+ * pktSlots[pktBack] and publishes it by swapping that index into
+ * pktMiddle; the LED task swaps it out to print it. This is the triple
+ * buffer of schedule.c, so no packet is copied under a critical section. */
+#define PKT_SLOT_FRESH 0x80u
+
+static PacketSchedule_t pktSlots[3];
+static uint8_t pktBack = 0;
+static uint8_t pktMiddle = 1;
+static uint8_t pktFront = 2;
+
+/* The last schedule accepted, which delta frames patch. Packet task only. */
+static PacketSchedule_t pktShadow;
+static uint8_t pktShadowValid = 0;
+
+/* Hand-off to StartScheduleStore. The packet task writes storePending
+ * between two increments of storeSeq; the store task copies it and tries
+ * again if storeSeq was odd or moved meanwhile. */
+static PacketSchedule_t storePending;
+static uint32_t storeSeq = 0;
+
+/* A new schedule is written to flash once no newer one has arrived for
+ * STORE_SETTLE_MS, or STORE_MAX_DEFER_MS after the first if they keep
+ * coming. */
+#ifndef STORE_SETTLE_MS
+#define STORE_SETTLE_MS    5000u
+#endif
+#ifndef STORE_MAX_DEFER_MS
+#define STORE_MAX_DEFER_MS 60000u
+#endif
+
+/* A spare sector is erased only while the lights are set to stay as they
+ * are for longer than an erase can take: 500 ms for a 16 KB sector at
+ * most (STM32F407 datasheet). While no such window is known the store
+ * task looks again every STORE_WINDOW_RETRY_MS. */
+#ifndef STORE_ERASE_MAX_MS
+#define STORE_ERASE_MAX_MS      500u
+#endif
+#ifndef STORE_WINDOW_RETRY_MS
+#define STORE_WINDOW_RETRY_MS   1000u
+#endif
+
+/* Tick until which the LED task leaves the lights alone unless a
+ * preemption request comes: the deadline of a fixed-length stage. Any
+ * earlier tick while the end is not known in advance (actuated greens,
+ * preemption, no schedule). Written by the LED task only. */
+static volatile TickType_t ledSteadyUntil = 0;
+
+static uint32_t storeSaveMaxMs = 0;
+static uint32_t storeEraseMaxMs = 0;
+static uint32_t bootToLightMs = 0;
+static uint8_t  firstLight = 0;
+
+volatile uint32_t gCycleCount = 0;
+volatile TickType_t gStageLateMaxTicks = 0;
+
+static uint32_t pktLatencyLastCycles = 0;
+static uint32_t pktLatencyMaxCycles = 0;
+static uint32_t pktCrcErrors = 0;
+static uint32_t pktDecodeErrors = 0;
+static uint32_t pktAccepted = 0;
+static uint32_t pktTimedDropped = 0;
+
+/* An actuated green never runs shorter than this, whatever offset_maxDed
+ * allows (unless its planned time is shorter still). */
+#ifndef ACTUATION_MIN_GREEN_MS
+#define ACTUATION_MIN_GREEN_MS 5000u
+#endif
+
+static uint32_t actGreensExtended = 0;
+static uint32_t actGreensCut = 0;
 
-extern void ApplyStageToLEDs(uint32_t pattern);
+/* Clearance steps ahead of and after a preemption, and the longest one may
+ * hold the lights if neither CLEAR nor its own hold time ends it. */
+#ifndef PREEMPT_YELLOW_MS
+#define PREEMPT_YELLOW_MS 3000u
+#endif
+#ifndef PREEMPT_ALL_RED_MS
+#define PREEMPT_ALL_RED_MS 2000u
+#endif
+#ifndef PREEMPT_MAX_HOLD_MS
+#define PREEMPT_MAX_HOLD_MS 120000u
+#endif
 
-static uint8_t lastPacketBuf[RX_BUFFER_SIZE];
-static uint16_t lastPacketLen = 0;
-static volatile uint8_t lastPacketAvailable = 0;
+/* The request the LED task is serving. LED task only. */
+static PacketPreempt_t ledPreempt;
+static uint32_t ledPreemptRxStamp;
 
-static TimerHandle_t xStageTimer = NULL;
+static uint32_t preemptCount = 0;
+static uint32_t preemptRefused = 0;
+static uint32_t preemptReactMaxCycles = 0;
+
+/* Most of its longest stage one cycle may gain or lose to line its start
+ * up with the shared clock. */
+#define CYCLE_ALIGN_MAX_PCT 20
+
+static uint32_t cyclePhaseErrMs = 0;
+
+/* Time each task spends between wake-up and blocking again, in Perf cycles. */
+static uint64_t packetTaskBusyCycles = 0;
+static uint64_t ledTaskBusyCycles = 0;
+
+/* Probe histograms are logged once the link has been quiet for
+ * PROBE_REPORT_IDLE_MS, one probe every PROBE_REPORT_GAP_MS so the log ring
+ * drains in between and a new frame is never held up by the report. */
+#define PROBE_REPORT_IDLE_MS 1000
+#define PROBE_REPORT_GAP_MS  100
+
+#if PROBE_ENABLE
+static uint8_t probeReportNext = PROBE_COUNT;
+static uint32_t probeReportedCount = 0;
+#endif
 
-static void PrintUART_Local(const char *buf);
 static void PrintStoredPacketOnce(void);
+static void NotifyLedTask(void);
+static void SendStatsReply(void);
+static void HandleTimeFrame(uint8_t addr, const uint8_t *payload, uint16_t len, uint32_t rxStamp);
 void StartPacketProcessor(void *argument);
 void StartLEDController(void *argument);
-void InitStageTimer(void);
-static void vStageTimerCallback(TimerHandle_t xTimer);
+void StartScheduleStore(void *argument);
+void RestoreLastKnownGood(void);
+
+/* With configSUPPORT_STATIC_ALLOCATION the kernel's own tasks take their
+ * memory from here too. */
+static StaticTask_t idleTaskCb;
+static StackType_t idleTaskStack[configMINIMAL_STACK_SIZE];
 
-static void PrintUART_Local(const char *buf)
+void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer,
+                                   uint32_t *pulIdleTaskStackSize)
 {
-    if (xUART_Mutex != NULL)
-    {
-        if (xSemaphoreTake(xUART_Mutex, pdMS_TO_TICKS(100)) == pdTRUE)
-        {
-            HAL_UART_Transmit(&huart6, (uint8_t*)buf, strlen(buf), HAL_MAX_DELAY);
-            xSemaphoreGive(xUART_Mutex);
-            return;
-        }
-    }
-    HAL_UART_Transmit(&huart6, (uint8_t*)buf, strlen(buf), HAL_MAX_DELAY);
+    *ppxIdleTaskTCBBuffer = &idleTaskCb;
+    *ppxIdleTaskStackBuffer = idleTaskStack;
+    *pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
 }
 
-static void vStageTimerCallback(TimerHandle_t xTimer)
+#if configUSE_TIMERS
+static StaticTask_t timerTaskCb;
+static StackType_t timerTaskStack[configTIMER_TASK_STACK_DEPTH];
+
+void vApplicationGetTimerTaskMemory(StaticTask_t **ppxTimerTaskTCBBuffer, StackType_t **ppxTimerTaskStackBuffer,
+                                    uint32_t *pulTimerTaskStackSize)
 {
-    (void)xTimer;
-    if (ledTaskHandle != NULL)
-    {
-        xTaskNotifyGive((TaskHandle_t)ledTaskHandle);
-    }
+    *ppxTimerTaskTCBBuffer = &timerTaskCb;
+    *ppxTimerTaskStackBuffer = timerTaskStack;
+    *pulTimerTaskStackSize = configTIMER_TASK_STACK_DEPTH;
 }
+#endif
 
-void InitStageTimer(void)
+static void PrintStoredPacketOnce(void)
 {
-    if (xStageTimer == NULL)
+    if ((__atomic_load_n(&pktMiddle, __ATOMIC_ACQUIRE) & PKT_SLOT_FRESH) == 0) return;
+
+    pktFront = __atomic_exchange_n(&pktMiddle, pktFront, __ATOMIC_ACQ_REL) & (uint8_t)~PKT_SLOT_FRESH;
+    const PacketSchedule_t *pkt = &pktSlots[pktFront];
+
+    LOG_EVENT0(LOG_TOK_PKT_HEADER);
+    LOG_EVENT(LOG_TOK_PKT_STAGE_NUM, pkt->stageNum);
+    LOG_EVENT(LOG_TOK_PKT_MAX_LIGHT, pkt->maxLight);
+    Log_Event(LOG_TOK_PKT_STAGE_TIMES, pkt->stageTimes_ms, PACKET_LEGACY_STAGES);
+
+    int shown = (pkt->stageNum > PACKET_LEGACY_STAGES) ? pkt->stageNum : PACKET_LEGACY_STAGES;
+    for (int i = PACKET_LEGACY_STAGES; i < shown; i++)
+    {
+        LOG_EVENT(LOG_TOK_PKT_STAGE_TIME, (uint32_t)(i + 1), pkt->stageTimes_ms[i]);
+    }
+
+    LOG_EVENT0(LOG_TOK_PKT_STAGES_HDR);
+    for (int i = 0; i < shown; i++)
     {
-        xStageTimer = xTimerCreate("StageTimer",pdMS_TO_TICKS(1),pdFALSE,NULL,vStageTimerCallback);
+        LOG_EVENT(LOG_TOK_PKT_STAGE, (uint32_t)(i + 1), pkt->stages[i]);
     }
+
+    LOG_EVENT(LOG_TOK_PKT_FLAGS, pkt->greenExt, pkt->interrupt);
+    LOG_EVENT(LOG_TOK_PKT_LATENCY, Perf_CyclesToUs(pktLatencyLastCycles), Perf_CyclesToUs(pktLatencyMaxCycles));
 }
 
-static void PrintStoredPacketOnce(void)
+/* The LED task sleeps until its next deadline; without a schedule that is
+ * only a time-activated queue entry, so it is told about new ones. */
+static void NotifyLedTask(void)
 {
-    if (!lastPacketAvailable || lastPacketLen == 0) return;
+    if (ledTaskHandle != NULL) xTaskNotify((TaskHandle_t)ledTaskHandle, LED_NOTIFY_SCHEDULE, eSetBits);
+}
 
-    uint8_t localBuf[RX_BUFFER_SIZE];
-    uint16_t len = 0;
+static uint32_t CyclesToMs(uint64_t cycles)
+{
+    return (uint32_t)(cycles / (SystemCoreClock / 1000u));
+}
+
+static uint32_t TicksToMs(TickType_t ticks)
+{
+    return (uint32_t)((uint64_t)ticks * 1000u / configTICK_RATE_HZ);
+}
+
+/* The controller's own clock, which ClockSync maps onto shared time. */
+static uint32_t ControllerLocalMs(void)
+{
+    return TicksToMs(xTaskGetTickCount());
+}
+
+/* Answers a PACKET_TYPE_STATS query on the log UART; the LED task keeps
+ * running throughout. Only queries sent to this unit's own address are
+ * answered, so controllers sharing a bus never reply at the same time. */
+static void SendStatsReply(void)
+{
+    uint32_t field[STATS_FIELD_COUNT];
 
     taskENTER_CRITICAL();
-    len = lastPacketLen;
-    if (len > RX_BUFFER_SIZE) len = RX_BUFFER_SIZE;
-    memcpy(localBuf, lastPacketBuf, len);
-    lastPacketAvailable = 0;
+    uint64_t ledBusy = ledTaskBusyCycles;
     taskEXIT_CRITICAL();
 
+    field[STATS_UPTIME_MS]              = (uint32_t)((uint64_t)xTaskGetTickCount() * 1000u / configTICK_RATE_HZ);
+    field[STATS_RX_ISR_COUNT]           = rxIsrCount;
+    field[STATS_RX_ISR_MAX_NS]          = Perf_CyclesToNs(rxIsrMaxCycles);
+    field[STATS_FRAMES_ACCEPTED]        = pktAccepted;
+    field[STATS_FRAMES_REJECTED]        = rxFramesRejected;
+    field[STATS_FRAMES_DROPPED]         = rxFramesDropped;
+    field[STATS_CRC_ERRORS]             = pktCrcErrors;
+    field[STATS_DECODE_ERRORS]          = pktDecodeErrors;
+    field[STATS_LOG_DROPPED]            = Log_Dropped();
+    field[STATS_CYCLE_COUNT]            = gCycleCount;
+    field[STATS_STAGE_LATE_MAX_MS]      = (uint32_t)((uint64_t)gStageLateMaxTicks * 1000u / configTICK_RATE_HZ);
+    field[STATS_RX_TO_DECODE_MAX_US]    = Perf_CyclesToUs(pktLatencyMaxCycles);
+    field[STATS_PACKET_TASK_CPU_MS]     = CyclesToMs(packetTaskBusyCycles);
+    field[STATS_PACKET_TASK_STACK_FREE] = osThreadGetStackSpace(packetTaskHandle);
+    field[STATS_LED_TASK_CPU_MS]        = CyclesToMs(ledBusy);
+    field[STATS_LED_TASK_STACK_FREE]    = osThreadGetStackSpace(ledTaskHandle);
+    field[STATS_FRAMES_FILTERED]        = rxFramesFiltered;
+    field[STATS_TIMED_PENDING]          = ScheduleQueue_Pending();
+    field[STATS_TIMED_DROPPED]          = pktTimedDropped;
+    field[STATS_DETECTOR_CALLS]         = gDetectorCalls;
+    field[STATS_GREENS_EXTENDED]        = actGreensExtended;
+    field[STATS_GREENS_CUT]             = actGreensCut;
+    field[STATS_CLOCK_SETS]             = ClockSync_SetCount();
+    field[STATS_CYCLE_PHASE_ERR_MS]     = cyclePhaseErrMs;
+    field[STATS_PREEMPTS]               = preemptCount;
+    field[STATS_PREEMPTS_REFUSED]       = preemptRefused;
+    field[STATS_PREEMPT_REACT_MAX_US]   = Perf_CyclesToUs(preemptReactMaxCycles);
+    field[STATS_FRAME_POOL_MIN_FREE]    = FramePool_MinFree();
+    field[STATS_WAKEUPS]                = Power_Wakeups();
+    field[STATS_SLEEPS]                 = Power_Sleeps();
+    field[STATS_IDLE_MS]                = Power_IdleMs();
+    field[STATS_CONFLICTS_REJECTED]     = Conflict_Rejected();
+    field[STATS_CONFLICT_CACHE_HITS]    = Conflict_CacheHits();
+    field[STATS_STORE_WRITES]           = ScheduleStore_Writes();
+    field[STATS_STORE_ERASES]           = ScheduleStore_Erases();
+    field[STATS_STORE_SAVE_MAX_MS]      = storeSaveMaxMs;
+    field[STATS_BOOT_TO_LIGHT_MS]       = bootToLightMs;
+    field[STATS_STORE_ERASE_MAX_MS]     = storeEraseMaxMs;
+
+    uint8_t payload[3 + 4 * STATS_FIELD_COUNT];
     uint16_t idx = 0;
-    for (uint16_t i = 0; i + 2 < len; i++)
+    payload[idx++] = PACKET_TYPE_STATS;
+    payload[idx++] = STATS_VERSION;
+    payload[idx++] = STATS_FIELD_COUNT;
+    for (int i = 0; i < STATS_FIELD_COUNT; i++)
     {
-        if (localBuf[i] == 0x53 && localBuf[i+1] == 0x4F && localBuf[i+2] == 0x46)
-        {
-            idx = i + 3;
-            break;
-        }
+        payload[idx++] = (uint8_t)(field[i] >> 24);
+        payload[idx++] = (uint8_t)(field[i] >> 16);
+        payload[idx++] = (uint8_t)(field[i] >> 8);
+        payload[idx++] = (uint8_t)field[i];
+    }
+
+    uint8_t reply[PACKET_WIRE_LEN(sizeof(payload))];
+    Log_WriteBytes(reply, PacketCodec_Encode(gControllerAddress, payload, idx, reply));
+}
+
+/* PING and SET are taken on this unit's own address only: a pong must not
+ * collide with other controllers' on a shared bus, and a clock model is
+ * per controller. The ping's receive time is backdated to the ISR's EOF
+ * stamp, so the time its frame buffer waited in the frame queue is not
+ * mistaken for link delay. */
+static void HandleTimeFrame(uint8_t addr, const uint8_t *payload, uint16_t len, uint32_t rxStamp)
+{
+    PacketTime_t t;
+    if (!PacketCodec_DecodeTime(payload, len, &t))
+    {
+        pktDecodeErrors++;
+        return;
     }
+    if (addr != gControllerAddress) return;
 
-    if (idx == 0)
+    if (t.kind == PACKET_TIME_SET)
     {
-        PrintUART_Local("\r\nNEW PACKET RECEIVED\r\n");
-        PrintUART_Local("No SOF found\r\n");
+        ClockSync_Set(t.refLocalMs, t.sharedAtRefMs, t.driftPpb);
+        NotifyLedTask();
+        LOG_EVENT(LOG_TOK_CLOCK_SET, (uint32_t)t.driftPpb);
         return;
     }
 
-    char msg[256];
+    uint32_t rxLocalMs = ControllerLocalMs() - CyclesToMs(Perf_Now() - rxStamp);
+    uint8_t pong[PACKET_TIME_PONG_LEN];
+    uint8_t reply[PACKET_WIRE_LEN(PACKET_TIME_PONG_LEN)];
+    uint16_t pongLen = PacketCodec_EncodeTimePong(t.cookie, rxLocalMs, ControllerLocalMs(), pong);
+    Log_WriteBytes(reply, PacketCodec_Encode(gControllerAddress, pong, pongLen, reply));
+}
+
+static void BuildSchedule(Schedule_t *sched, const PacketSchedule_t *pkt)
+{
+    sched->stageNum = pkt->stageNum;
+    for (int i = 0; i < pkt->stageNum; i++)
+    {
+        sched->stagesPattern[i] = pkt->stages[i];
+        CompileStageOutput(pkt->stages[i], &sched->stageOutputs[i]);
+        sched->stageDetectors[i] = DetectorsForPattern(pkt->stages[i]);
+        uint32_t ms = pkt->stageTimes_ms[i];
+        if (ms == 0) ms = 1;
+        sched->stageTimes_ms[i] = ms;
+    }
+    /* green_Ext switches local actuation on; offset_* bound it. */
+    sched->gapTol_ms = pkt->greenExt ? pkt->offsetTol_ms : 0;
+    sched->maxDed_ms = pkt->offsetMaxDed_ms;
+    sched->maxExt_ms = pkt->offsetMaxExt_ms;
+    sched->phase_ms = pkt->offsetPhase_ms;
+    sched->interrupt = pkt->interrupt;
+}
 
-    if (idx + 2 <= len) idx += 2;
+/* Passes an accepted schedule to the store task, unless it is the one
+ * passed last: a Pi resending the same schedule never wakes that task. */
+static void RequestStore(const PacketSchedule_t *pkt)
+{
+    if (memcmp(&storePending, pkt, sizeof(*pkt)) == 0) return;
 
-    if (idx >= len)
+    __atomic_fetch_add(&storeSeq, 1u, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    storePending = *pkt;
+    __atomic_fetch_add(&storeSeq, 1u, __ATOMIC_RELEASE);
+    if (storeTaskHandle != NULL) xTaskNotifyGive((TaskHandle_t)storeTaskHandle);
+}
+
+/* Called from main() before the scheduler starts: publishes the schedule
+ * last stored in flash, so StartLEDController lights it on its first pass.
+ * It is checked against the conflict matrix again, which may have changed
+ * with the firmware. The Pi's first schedule replaces it at a cycle
+ * boundary as usual. */
+void RestoreLastKnownGood(void)
+{
+    PacketSchedule_t *pkt = &pktSlots[pktBack];
+    ConflictFault_t fault;
+    if (!ScheduleStore_Load(pkt)) return;
+    if (!Conflict_CheckSchedule(pkt->stages, pkt->stageNum, &fault))
     {
-        PrintUART_Local("\r\nNEW PACKET RECEIVED\r\n");
-        PrintUART_Local("Truncated packet\r\n");
+        LOG_EVENT0(LOG_TOK_STORE_REJECTED);
         return;
     }
 
-    uint8_t StageNum = (idx < len) ? localBuf[idx++] : 0;
-    uint8_t MaxLight = (idx < len) ? localBuf[idx++] : 0;
+    Schedule_t *sched = Schedule_BeginWrite();
+    BuildSchedule(sched, pkt);
+    sched->rxStamp = Perf_Now();
+    sched->publishStamp = sched->rxStamp;
+    Schedule_Publish();
 
-    uint32_t StageTimes_raw[8] = {0};
-    for (int i = 0; i < 8; i++)
+    pktShadow = *pkt;
+    pktShadowValid = 1;
+    storePending = *pkt;
+    LOG_EVENT(LOG_TOK_STORE_RESTORED, pkt->stageNum);
+    pktBack = __atomic_exchange_n(&pktMiddle, (uint8_t)(pktBack | PKT_SLOT_FRESH), __ATOMIC_ACQ_REL) & (uint8_t)~PKT_SLOT_FRESH;
+}
+
+/* Erases the spare sector once the LED task is in a stage with more than
+ * STORE_ERASE_MAX_MS left, so the erase never holds up a stage change.
+ * Interrupts keep collecting bytes and detector calls meanwhile, but no
+ * task runs: a preemption request waits for the erase to end. */
+static void EraseSpareWhenSteady(void)
+{
+    while (ScheduleStore_EraseDue())
     {
-        if (idx + 3 < len)
+        TickType_t now = xTaskGetTickCount();
+        int32_t left = (int32_t)(ledSteadyUntil - now);
+        if (left <= (int32_t)pdMS_TO_TICKS(STORE_ERASE_MAX_MS))
         {
-            StageTimes_raw[i] = ((uint32_t)localBuf[idx]   << 24) |((uint32_t)localBuf[idx+1] << 16) |((uint32_t)localBuf[idx+2] << 8)  |(uint32_t)localBuf[idx+3];
+            /* Try the next stage. */
+            vTaskDelay(left > 0 ? (TickType_t)left + 1u : pdMS_TO_TICKS(STORE_WINDOW_RETRY_MS));
+            continue;
         }
-        else
+
+        uint32_t start = Perf_Now();
+        int ok = ScheduleStore_EraseSpare();
+        uint32_t tookMs = CyclesToMs(Perf_Now() - start);
+        if (tookMs > storeEraseMaxMs) storeEraseMaxMs = tookMs;
+
+        if (!ok)
         {
-            StageTimes_raw[i] = 0;
+            LOG_EVENT0(LOG_TOK_STORE_FAILED);
+            return;
         }
-        idx += 4;
     }
+}
 
-    uint32_t Stages[8] = {0};
-    for (int i = 0; i < 8; i++)
+/* Writes accepted schedules to flash at the lowest priority. Programming a
+ * record takes a few ms and stalls flash fetches for about 16 us per word,
+ * so higher-priority tasks run between words. The spare sector is erased
+ * ahead of the write that needs it, in a window the LED task leaves. */
+void StartScheduleStore(void *argument)
+{
+    (void) argument;
+    static PacketSchedule_t pkt;
+
+    for (;;)
     {
-        if (idx + 3 < len)
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        TickType_t first = xTaskGetTickCount();
+        while (xTaskGetTickCount() - first < pdMS_TO_TICKS(STORE_MAX_DEFER_MS) &&
+               ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STORE_SETTLE_MS)) != 0)
         {
-            Stages[i] = ((uint32_t)localBuf[idx]   << 24) |((uint32_t)localBuf[idx+1] << 16) |((uint32_t)localBuf[idx+2] << 8)  |(uint32_t)localBuf[idx+3];
         }
-        else
+
+        uint32_t seq;
+        do
         {
-            Stages[i] = 0;
-        }
-        idx += 4;
-    }
+            seq = __atomic_load_n(&storeSeq, __ATOMIC_ACQUIRE);
+            pkt = storePending;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        } while ((seq & 1u) != 0 || seq != __atomic_load_n(&storeSeq, __ATOMIC_RELAXED));
 
-    uint8_t green_Ext = 0;
-    uint8_t Interrupt = 0;
-    if (idx < len) green_Ext = localBuf[idx++];
-    if (idx < len) Interrupt = localBuf[idx++];
+        EraseSpareWhenSteady();
 
-    PrintUART_Local("\r\nNEW PACKET RECEIVED\r\n");
-    snprintf(msg, sizeof(msg), "StageNum = %d\r\n", StageNum); PrintUART_Local(msg);
-    snprintf(msg, sizeof(msg), "MaxLight = %d\r\n", MaxLight); PrintUART_Local(msg);
+        uint32_t start = Perf_Now();
+        StoreResult_t res = ScheduleStore_Save(&pkt);
+        uint32_t tookMs = CyclesToMs(Perf_Now() - start);
+        if (tookMs > storeSaveMaxMs) storeSaveMaxMs = tookMs;
 
-    PrintUART_Local("StageTimes = [");
-    for (int i = 0; i < 8; i++)
+        if (res == STORE_FAILED || res == STORE_FULL) LOG_EVENT0(LOG_TOK_STORE_FAILED);
+    }
+}
+
+/* Verifies, decodes and applies one received frame in place. */
+static void ProcessFrame(const FrameBuf_t *buf)
+{
+    uint32_t rxStamp = buf->rxStamp;
+    const uint8_t *frame = buf->frame;
+    uint16_t frameLen = buf->len;
+    if (!PacketCodec_Verify(frame, frameLen))
     {
-        snprintf(msg, sizeof(msg), "%.2f", (float)StageTimes_raw[i] / 1000.0f);
-        PrintUART_Local(msg);
-        if (i < 7) PrintUART_Local(", ");
+        pktCrcErrors++;
+        LOG_EVENT0(LOG_TOK_PKT_CRC_MISMATCH);
+        return;
     }
-    PrintUART_Local("]\r\n");
 
-    PrintUART_Local("\r\nStages:\r\n");
-    for (int i = 0; i < 8; i++)
+    const uint8_t *payload = &frame[PACKET_HEADER_LEN];
+    uint16_t payloadLen = (uint16_t)(frameLen - PACKET_HEADER_LEN - PACKET_CRC_LEN);
+
+    PacketSchedule_t *pkt = &pktSlots[pktBack];
+    uint8_t timed = 0;
+    uint8_t when = 0;
+    uint32_t at = 0;
+    switch (PacketCodec_Type(payload, payloadLen))
     {
-        snprintf(msg, sizeof(msg), "Stage %d: [", i + 1); PrintUART_Local(msg);
-        for (int bit = 11; bit >= 0; bit--)
+    case PACKET_TYPE_LEGACY:
+    case PACKET_TYPE_COMPACT:
+        if (!PacketCodec_Decode(payload, payloadLen, pkt))
         {
-            int val = (int)((Stages[i] >> bit) & 0x01);
-            snprintf(msg, sizeof(msg), "%d", val);
-            PrintUART_Local(msg);
-            if (bit != 0) PrintUART_Local(", ");
+            pktDecodeErrors++;
+            LOG_EVENT0(LOG_TOK_PKT_TRUNCATED);
+            return;
         }
-        PrintUART_Local("]\r\n");
+        break;
+
+    case PACKET_TYPE_DELTA:
+        /* Patched on a copy, so a bad delta leaves the schedule as it was. */
+        *pkt = pktShadow;
+        if (!pktShadowValid || !PacketCodec_ApplyDelta(payload, payloadLen, pkt))
+        {
+            pktDecodeErrors++;
+            LOG_EVENT0(LOG_TOK_PKT_DELTA_REJECTED);
+            return;
+        }
+        break;
+
+    case PACKET_TYPE_TIMED:
+        if (!PacketCodec_DecodeTimed(payload, payloadLen, &when, &at, pkt))
+        {
+            pktDecodeErrors++;
+            LOG_EVENT0(LOG_TOK_PKT_TRUNCATED);
+            return;
+        }
+        timed = 1;
+        break;
+
+    case PACKET_TYPE_STATS:
+        if (frame[0] == gControllerAddress) SendStatsReply();
+        return;
+
+    case PACKET_TYPE_TIME:
+        HandleTimeFrame(frame[0], payload, payloadLen, rxStamp);
+        return;
+
+    default:
+        pktDecodeErrors++;
+        return;
+    }
+
+    /* Checked before anything is kept, so a delta that fails leaves the
+     * shadow copy as it was. */
+    ConflictFault_t fault;
+    if (!Conflict_CheckSchedule(pkt->stages, pkt->stageNum, &fault))
+    {
+        LOG_EVENT(fault.kind == CONFLICT_DARK ? LOG_TOK_PKT_DARK :
+                  fault.kind == CONFLICT_CHANGE ? LOG_TOK_PKT_CONFLICT_CHANGE : LOG_TOK_PKT_CONFLICT,
+                  (uint32_t)(fault.stage + 1), fault.signals);
+        return;
+    }
+
+    /* Timed schedules are queued (ScheduleQueue_*); the rest replace the
+     * running one at its next cycle boundary. */
+    Schedule_t *sched = timed ? ScheduleQueue_BeginWrite() : Schedule_BeginWrite();
+    if (sched == NULL)
+    {
+        pktTimedDropped++;
+        LOG_EVENT0(LOG_TOK_PKT_QUEUE_FULL);
+        return;
+    }
+
+    if (!timed)
+    {
+        pktShadow = *pkt;
+        pktShadowValid = 1;
     }
 
-    snprintf(msg, sizeof(msg),"green_Ext = %d\r\nInterrupt = %d\r\n\r\n",green_Ext, Interrupt);
-    PrintUART_Local(msg);
+    pktLatencyLastCycles = Perf_Now() - rxStamp;
+    if (pktLatencyLastCycles > pktLatencyMaxCycles) pktLatencyMaxCycles = pktLatencyLastCycles;
+    Probe_Record(PROBE_RX_TO_DECODE, pktLatencyLastCycles);
+
+    BuildSchedule(sched, pkt);
+    sched->rxStamp = rxStamp;
+    sched->publishStamp = Perf_Now();
+    Probe_Record(PROBE_RX_TO_PUBLISH, sched->publishStamp - rxStamp);
+    if (timed)
+        ScheduleQueue_Commit((ScheduleActivation_t)when, at);
+    else
+        Schedule_Publish();
+    pktAccepted++;
+    NotifyLedTask();
+    if (!timed) RequestStore(pkt);
+
+    /* The decoded packet goes to PrintStoredPacketOnce by slot index. */
+    pktBack = __atomic_exchange_n(&pktMiddle, (uint8_t)(pktBack | PKT_SLOT_FRESH), __ATOMIC_ACQ_REL) & (uint8_t)~PKT_SLOT_FRESH;
 }
 
 void StartPacketProcessor(void *argument)
 {
     (void) argument;
-    uint8_t localBuf[RX_BUFFER_SIZE];
+    uint32_t busyStart = Perf_Now();
 
     for (;;)
     {
-        if (packetReady)
+        FrameBuf_t *buf = NULL;
+        packetTaskBusyCycles += Perf_Now() - busyStart;
+#if PROBE_ENABLE
+        /* Time out only while a report is due, so an idle link never
+         * wakes this task. */
+        TickType_t wait = portMAX_DELAY;
+        if (probeReportNext < PROBE_COUNT)
+            wait = pdMS_TO_TICKS(PROBE_REPORT_GAP_MS);
+        else if (Probe_Get(PROBE_RX_TO_PUBLISH)->count != probeReportedCount)
+            wait = pdMS_TO_TICKS(PROBE_REPORT_IDLE_MS);
+        BaseType_t got = xQueueReceive(xPacketQueue, &buf, wait);
+        busyStart = Perf_Now();
+        if (got != pdTRUE)
         {
-            taskENTER_CRITICAL();
-            uint16_t len = rxIndex;
-            if (len > RX_BUFFER_SIZE) len = RX_BUFFER_SIZE;
-            memcpy(localBuf, rxBuffer, len);
-            rxIndex = 0;
-            packetReady = 0;
-            taskEXIT_CRITICAL();
-
-            uint16_t idx = 0;
-            for (uint16_t i = 0; i + 2 < len; i++)
+            if (probeReportNext < PROBE_COUNT)
             {
-                if (localBuf[i] == 0x53 && localBuf[i+1] == 0x4F && localBuf[i+2] == 0x46)
-                {
-                    idx = i + 3;
-                    break;
-                }
+                Probe_Report((ProbeId_t)probeReportNext++);
             }
-
-            taskENTER_CRITICAL();
-            lastPacketLen = len;
-            if (lastPacketLen > RX_BUFFER_SIZE) lastPacketLen = RX_BUFFER_SIZE;
-            memcpy(lastPacketBuf, localBuf, lastPacketLen);
-            lastPacketAvailable = 1;
-            taskEXIT_CRITICAL();
-
-            if (idx != 0)
+            else if (Probe_Get(PROBE_RX_TO_PUBLISH)->count != probeReportedCount)
             {
-                idx += 2;
-
-                if (idx + 1 < len)
-                {
-                    uint8_t StageNum = localBuf[idx++];
-                    uint8_t MaxLight = localBuf[idx++];
-
-                    uint32_t StageTimes_raw[8] = {0};
-                    for (int i = 0; i < 8 && idx + 3 < len; i++)
-                    {
-                        StageTimes_raw[i] = ((uint32_t)localBuf[idx] << 24) |((uint32_t)localBuf[idx+1] << 16) |((uint32_t)localBuf[idx+2] << 8)|(uint32_t)localBuf[idx+3];
-                        idx += 4;
-                    }
-
-                    uint32_t Stages[8] = {0};
-                    for (int i = 0; i < 8 && idx + 3 < len; i++)
-                    {
-                        Stages[i] = ((uint32_t)localBuf[idx] << 24) | ((uint32_t)localBuf[idx+1] << 16) | ((uint32_t)localBuf[idx+2] << 8)| (uint32_t)localBuf[idx+3];
-                        idx += 4;
-                    }
-
-                    if (xData_Mutex != NULL)
-                    {
-                        if (xSemaphoreTake(xData_Mutex, portMAX_DELAY) == pdTRUE)
-                        {
-                            gStageNum = StageNum;
-                            for (int i = 0; i < 8; i++)
-                            {
-                                gStagesPattern[i] = Stages[i];
-                                uint32_t ms = StageTimes_raw[i];
-                                if (ms == 0) ms = 1;
-                                gStageTimes_ms[i] = ms;
-                            }
-                            gScheduleValid = 1;
-                            xSemaphoreGive(xData_Mutex);
-                        }
-                    }
-                }
+                probeReportedCount = Probe_Get(PROBE_RX_TO_PUBLISH)->count;
+                probeReportNext = 0;
             }
+            continue;
+        }
+#else
+        xQueueReceive(xPacketQueue, &buf, portMAX_DELAY);
+        busyStart = Perf_Now();
+#endif
+        if (buf == NULL) continue;
+
+        ProcessFrame(buf);
+        FramePool_Free(buf);
+    }
+}
+
+/* Stage deadlines are absolute: each one is the cycle origin plus the
+ * summed stage durations, so logging, GPIO work and tick rounding never
+ * accumulate into drift against wall-clock time. */
+static TickType_t ScheduleMsToTicks(uint64_t ms)
+{
+    return (TickType_t)((ms * configTICK_RATE_HZ) / 1000u);
+}
+
+/* Controller time used by PACKET_ACTIVATE_TIME_MS: the low 32 bits of the
+ * shared clock once synchronised, so one activation time means the same
+ * instant on every controller; local time before that. Wraps every 49.7
+ * days, so activation times are compared as signed differences. */
+static uint32_t ControllerTimeMs(void)
+{
+    return (uint32_t)ClockSync_SharedMs(ControllerLocalMs());
+}
+
+/* cycleStart: the LED controller is about to begin stage 1, which will be
+ * cycle number gCycleCount + 1. */
+static int ActivationDue(ScheduleActivation_t when, uint32_t at, int cycleStart)
+{
+    if (when == SCHEDULE_AT_CYCLE)
+        return cycleStart && (int32_t)(gCycleCount + 1u - at) >= 0;
+    return (int32_t)(ControllerTimeMs() - at) >= 0;
+}
+
+/* With a synchronised clock a cycle should start offset_phase after a
+ * whole number of cycles from the shared epoch (Unix time 0), so that
+ * neighbours running the same cycle length hold a fixed offset to each
+ * other. Given the local start of the cycle about to run, picks a trim for
+ * its longest stage that moves the next cycle start back into line,
+ * capped at CYCLE_ALIGN_MAX_PCT of that stage; the running stage is never
+ * cut. trimIdx is SCHEDULE_MAX_STAGES when there is nothing to trim. */
+static void CycleAlign(const Schedule_t *sched, uint32_t startLocalMs, uint8_t *trimIdx, int32_t *trimMs)
+{
+    *trimIdx = SCHEDULE_MAX_STAGES;
+    *trimMs = 0;
+    if (!ClockSync_Valid()) return;
+
+    int64_t cycleMs = 0;
+    uint8_t longest = 0;
+    for (uint8_t i = 0; i < sched->stageNum; i++)
+    {
+        cycleMs += sched->stageTimes_ms[i];
+        if (sched->stageTimes_ms[i] > sched->stageTimes_ms[longest]) longest = i;
+    }
+    if (cycleMs == 0) return;
+
+    int64_t late = (ClockSync_SharedMs(startLocalMs) - (int64_t)sched->phase_ms) % cycleMs;
+    if (late < 0) late += cycleMs;
+    if (2 * late > cycleMs) late -= cycleMs;
+    cyclePhaseErrMs = (uint32_t)((late < 0) ? -late : late);
+
+    int64_t limit = (int64_t)sched->stageTimes_ms[longest] * CYCLE_ALIGN_MAX_PCT / 100;
+    int64_t trim = -late;
+    if (trim > limit) trim = limit;
+    if (trim < -limit) trim = -limit;
+    if (trim == 0) return;
+
+    *trimIdx = longest;
+    *trimMs = (int32_t)trim;
+    LOG_EVENT(LOG_TOK_CYCLE_ALIGN, (uint32_t)(int32_t)late, (uint32_t)*trimMs);
+}
+
+/* End of an actuated green in ms from its start, given the latest call
+ * from one of its detectors: gapTol_ms after that call, but no earlier
+ * than the planned time less maxDed_ms and no later than the planned time
+ * plus maxExt_ms. */
+static uint32_t ActuatedGreenEndMs(const Schedule_t *sched, uint32_t plannedMs, uint32_t lastCallMs)
+{
+    uint32_t minMs = (plannedMs > sched->maxDed_ms) ? plannedMs - sched->maxDed_ms : 0;
+    uint32_t floorMs = (plannedMs < ACTUATION_MIN_GREEN_MS) ? plannedMs : ACTUATION_MIN_GREEN_MS;
+    if (minMs < floorMs) minMs = floorMs;
+    uint32_t maxMs = plannedMs + sched->maxExt_ms;
+
+    uint32_t endMs = lastCallMs + sched->gapTol_ms;
+    if (endMs < minMs) endMs = minMs;
+    if (endMs > maxMs) endMs = maxMs;
+    return endMs;
+}
+
+/* Takes the latest preemption request into ledPreempt. Returns 1 if it is
+ * a START this schedule accepts (its Interrupt field is non-zero, or no
+ * schedule runs yet); a CLEAR with nothing running or a refused START is
+ * dropped here. */
+static int AcceptPreempt(const Schedule_t *sched)
+{
+    taskENTER_CRITICAL();
+    ulTaskNotifyValueClear(NULL, LED_NOTIFY_PREEMPT);
+    ledPreempt = gPreemptRequest;
+    ledPreemptRxStamp = gPreemptRxStamp;
+    taskEXIT_CRITICAL();
+
+    if (ledPreempt.action != PACKET_PREEMPT_START) return 0;
+    if (sched != NULL && sched->interrupt == 0)
+    {
+        preemptRefused++;
+        LOG_EVENT0(LOG_TOK_PREEMPT_REFUSED);
+        return 0;
+    }
+    uint16_t signals;
+    uint8_t kind;
+    if (!Conflict_CheckPattern(ledPreempt.pattern, &signals, &kind))
+    {
+        preemptRefused++;
+        LOG_EVENT(kind == CONFLICT_DARK ? LOG_TOK_PREEMPT_DARK : LOG_TOK_PREEMPT_CONFLICT, signals);
+        return 0;
+    }
+    return 1;
+}
+
+/* Runs stage idx, which started stageStartMs into the cycle, to its
+ * absolute deadline. An actuated green re-decides its end on every call
+ * from one of its detectors (HAL_GPIO_EXTI_Callback notifies this task).
+ * An accepted preemption request ends any stage at once and sets
+ * *preempted. plannedMs includes any CycleAlign trim. Returns the stage's
+ * length in ms. */
+static uint32_t RunStage(const Schedule_t *sched, uint8_t idx, uint32_t plannedMs, TickType_t originTick,
+                         uint64_t stageStartMs, uint32_t *busyStart, uint8_t *preempted)
+{
+    uint8_t actuated = (sched->gapTol_ms != 0 && sched->stageDetectors[idx] != 0);
+    uint32_t endMs = actuated ? ActuatedGreenEndMs(sched, plannedMs, 0) : plannedMs;
+    TickType_t startTick = originTick + ScheduleMsToTicks(stageStartMs);
+    uint32_t calls = 0;
+
+    /* Calls that arrived before this stage are not gaps in its traffic. */
+    xTaskNotifyWait(0, LED_NOTIFY_EVENTS, &calls, 0);
+    *preempted = (calls & LED_NOTIFY_PREEMPT) ? (uint8_t)AcceptPreempt(sched) : 0;
+    if (*preempted) endMs = TicksToMs(xTaskGetTickCount() - startTick);
+    ledSteadyUntil = (actuated || *preempted) ? startTick : originTick + ScheduleMsToTicks(stageStartMs + endMs);
+
+    while (!*preempted)
+    {
+        TickType_t deadline = originTick + ScheduleMsToTicks(stageStartMs + endMs);
+        TickType_t now = xTaskGetTickCount();
+        if ((int32_t)(deadline - now) <= 0) break;
+
+        calls = 0;
+        ledTaskBusyCycles += Perf_Now() - *busyStart;
+        BaseType_t notified = xTaskNotifyWait(0, LED_NOTIFY_EVENTS, &calls, deadline - now);
+        *busyStart = Perf_Now();
+
+        if (notified != pdTRUE) continue;
+        if ((calls & LED_NOTIFY_PREEMPT) && AcceptPreempt(sched))
+        {
+            *preempted = 1;
+            ledSteadyUntil = startTick;
+            endMs = TicksToMs(xTaskGetTickCount() - startTick);
+            break;
+        }
+        if (!actuated || (calls & sched->stageDetectors[idx]) == 0) continue;
+
+        endMs = ActuatedGreenEndMs(sched, plannedMs, TicksToMs(xTaskGetTickCount() - startTick));
+        Probe_Record(PROBE_DETECTOR_TO_DECISION, Perf_Now() - gDetectorCallStamp);
+    }
+
+    if (actuated && !*preempted)
+    {
+        if (endMs > plannedMs) actGreensExtended++;
+        else if (endMs < plannedMs) actGreensCut++;
+        if (endMs != plannedMs) LOG_EVENT(LOG_TOK_ACT_GREEN, (uint32_t)(idx + 1), plannedMs, endMs);
+    }
+    return endMs;
+}
+
+/* Lights pattern; the first change made for a preemption request records
+ * how long after its EOF the lights started to react. */
+static void ShowPattern(uint32_t pattern, uint8_t *answered)
+{
+    StageOutput_t out;
+    CompileStageOutput(pattern, &out);
+    ApplyStageToLEDs(&out);
+
+    if (!*answered)
+    {
+        uint32_t reactCycles = Perf_Now() - ledPreemptRxStamp;
+        if (reactCycles > preemptReactMaxCycles) preemptReactMaxCycles = reactCycles;
+        Probe_Record(PROBE_PREEMPT_REACT, reactCycles);
+        *answered = 1;
+    }
+}
+
+/* Moves the lights from `showing` towards `target` through the yellow and
+ * all-red steps (ClearancePattern), skipping a step that changes nothing.
+ * A yellow the schedule had already lit still gets a full yellow step.
+ * Steps are never cut short. Returns with the last step still lit. */
+static uint32_t ClearTowards(uint32_t showing, uint32_t target, uint8_t *answered, uint32_t *busyStart)
+{
+    static const uint32_t stepMs[2] = { PREEMPT_YELLOW_MS, PREEMPT_ALL_RED_MS };
+
+    for (int step = 0; step < 2; step++)
+    {
+        uint32_t pattern = ClearancePattern(showing, target, step);
+        /* Cleared to itself, only lit yellows turn into something else. */
+        uint32_t yellowLit = (step == 0) ? (showing & ~ClearancePattern(showing, showing, 1)) : 0;
+        if (pattern == showing && yellowLit == 0) continue;
+
+        ShowPattern(pattern, answered);
+        showing = pattern;
+
+        TickType_t wake = xTaskGetTickCount();
+        ledTaskBusyCycles += Perf_Now() - *busyStart;
+        xTaskDelayUntil(&wake, pdMS_TO_TICKS(stepMs[step]));
+        *busyStart = Perf_Now();
+    }
+    return showing;
+}
+
+/*
+ * Serves the accepted request in ledPreempt while `showing` is lit. This
+ * is the highest-priority task and the RX ISR wakes it directly, so the
+ * lights start clearing within microseconds of the frame's EOF and the
+ * preemption pattern is lit at most PREEMPT_YELLOW_MS + PREEMPT_ALL_RED_MS
+ * later. It holds until CLEAR, its hold time or PREEMPT_MAX_HOLD_MS; a new
+ * START during the hold clears across to the new pattern. Returns the
+ * pattern left lit; the caller then picks the schedule to resume with
+ * (one published during the hold included) and EndPreemption clears
+ * towards its stage 1.
+ */
+static uint32_t HoldPreemption(uint32_t showing, uint32_t *busyStart)
+{
+    PacketPreempt_t req = ledPreempt;
+
+    while (req.action == PACKET_PREEMPT_START)
+    {
+        uint8_t answered = 0;
+        preemptCount++;
+        LOG_EVENT(LOG_TOK_PREEMPT_START, req.pattern, req.hold_ms);
+        showing = ClearTowards(showing, req.pattern, &answered, busyStart);
+        ShowPattern(req.pattern, &answered);
+        showing = req.pattern;
+
+        uint32_t holdMs = (req.hold_ms == 0 || req.hold_ms > PREEMPT_MAX_HOLD_MS) ? PREEMPT_MAX_HOLD_MS : req.hold_ms;
+        TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(holdMs);
+        req.action = PACKET_PREEMPT_CLEAR;
+
+        for (;;)
+        {
+            TickType_t now = xTaskGetTickCount();
+            if ((int32_t)(deadline - now) <= 0) break;
+
+            uint32_t bits = 0;
+            ledTaskBusyCycles += Perf_Now() - *busyStart;
+            xTaskNotifyWait(0, LED_NOTIFY_EVENTS, &bits, deadline - now);
+            *busyStart = Perf_Now();
+            if ((bits & LED_NOTIFY_PREEMPT) == 0) continue;
+
+            /* CLEAR, or a START that replaces this one. */
+            AcceptPreempt(NULL);
+            req = ledPreempt;
+            break;
         }
+    }
+    return showing;
+}
+
+/* Exit clearance to stage 1 of sched, or to all red without one. */
+static uint32_t EndPreemption(const Schedule_t *sched, uint32_t showing, uint32_t *busyStart)
+{
+    uint8_t answered = 1;
+    uint32_t resume = (sched != NULL) ? sched->stagesPattern[0] : ClearancePattern(showing, 0, 1);
+    showing = ClearTowards(showing, resume, &answered, busyStart);
+    if (sched == NULL) ShowPattern(resume, &answered);
+    LOG_EVENT0(LOG_TOK_PREEMPT_END);
+    return resume;
+}
 
-        vTaskDelay(pdMS_TO_TICKS(10));
+/* The schedule to run from this stage boundary on: a queued one whose
+ * activation point is due, or at a cycle start a newly published one. NULL
+ * keeps the current schedule. */
+static const Schedule_t *PickSchedule(int cycleStart, const Schedule_t **lastImmediate, uint8_t *queueHeld)
+{
+    ScheduleActivation_t when;
+    uint32_t at;
+    const Schedule_t *planned = ScheduleQueue_Peek(&when, &at);
+
+    if (planned != NULL && ActivationDue(when, at, cycleStart))
+    {
+        ScheduleQueue_Take();
+        *queueHeld = 1;
+        return planned;
     }
+    if (!cycleStart) return NULL;
+
+    const Schedule_t *latest = Schedule_AcquireLatest();
+    if (latest == *lastImmediate) return NULL;
+    *lastImmediate = latest;
+    if (*queueHeld)
+    {
+        ScheduleQueue_Release();
+        *queueHeld = 0;
+    }
+    return latest;
+}
+
+/* Light-out latency of a newly adopted schedule, and how far the interval
+ * since the previous stage change strayed from that stage's duration.
+ * Returns the stamp of this stage change. */
+static uint32_t StageProbeRecord(const Schedule_t *sched, uint8_t adopted, uint32_t prevApplyStamp, uint32_t prevStageMs)
+{
+#if PROBE_ENABLE
+    uint32_t now = Perf_Now();
+
+    if (adopted)
+    {
+        Probe_Record(PROBE_PUBLISH_TO_LIGHT, now - sched->publishStamp);
+        Probe_Record(PROBE_RX_TO_LIGHT, now - sched->rxStamp);
+    }
+
+    uint64_t nominal = (uint64_t)prevStageMs * (SystemCoreClock / 1000u);
+    if (prevStageMs != 0 && nominal < 0x80000000u)
+    {
+        int32_t err = (int32_t)((now - prevApplyStamp) - (uint32_t)nominal);
+        Probe_Record(PROBE_STAGE_JITTER, (uint32_t)((err < 0) ? -err : err));
+    }
+    return now;
+#else
+    (void)sched;
+    (void)adopted;
+    (void)prevApplyStamp;
+    (void)prevStageMs;
+    return 0;
+#endif
 }
 
 void StartLEDController(void *argument)
 {
     (void) argument;
+    const Schedule_t *sched = NULL;
+    const Schedule_t *lastImmediate = NULL;
+    uint8_t queueHeld = 0;
+    TickType_t originTick = 0;
+    uint64_t elapsedMs = 0;
+    uint8_t adopted = 0;
+    uint32_t prevApplyStamp = 0;
+    uint32_t prevStageMs = 0;
+    uint8_t trimIdx = SCHEDULE_MAX_STAGES;
+    int32_t trimMs = 0;
+    uint32_t showing = 0;
+    const Schedule_t *resumeWith = NULL;
+    uint8_t justResumed = 0;
+    uint32_t busyStart = Perf_Now();
+
     for (;;)
     {
-        if (gScheduleValid && gStageNum > 0)
+        /* After a preemption the schedule was already picked before the
+         * exit clearance, which led to its stage 1; NULL there means the
+         * running one. Nothing is picked on that pass: a schedule that
+         * came in during the clearance waits for the next cycle start
+         * and its adoption check. */
+        int cycleStart = (sched == NULL || gCurrentStageIdx == 0);
+        uint8_t resumed = justResumed;
+        const Schedule_t *next = resumed ? resumeWith : PickSchedule(cycleStart, &lastImmediate, &queueHeld);
+        resumeWith = NULL;
+        justResumed = 0;
+
+        if (next != NULL)
         {
-            uint8_t  localIdx      = 0;
-            uint32_t localDelayMs  = 1;
-            uint32_t localPattern  = 0;
+            /* The schedule check covers the new schedule's own stage
+             * changes only; the change into its stage 1 from whatever is
+             * lit (the old last stage, or any stage when a timed one comes
+             * due) is checked here, and cleared like a preemption if it
+             * is not allowed. */
+            uint16_t signals;
+            uint8_t cleared = 0;
+            if (!resumed && !Conflict_CheckChange(showing, next->stagesPattern[0], &signals))
+            {
+                uint8_t answered = 1;
+                LOG_EVENT(LOG_TOK_ADOPT_CLEARANCE, signals);
+                showing = ClearTowards(showing, next->stagesPattern[0], &answered, &busyStart);
+                cleared = 1;
+            }
 
-            if (xData_Mutex != NULL)
+            adopted = 1;
+            if (sched == NULL || cleared)
             {
-                if (xSemaphoreTake(xData_Mutex, portMAX_DELAY) == pdTRUE)
-                {
-                    localIdx     = gCurrentStageIdx;
-                    localDelayMs = gStageTimes_ms[localIdx];
-                    localPattern = gStagesPattern[localIdx];
-                    xSemaphoreGive(xData_Mutex);
-                }
+                originTick = xTaskGetTickCount();
+                elapsedMs = 0;
+                prevStageMs = 0;
             }
+            sched = next;
+            gCurrentStageIdx = 0;
+        }
+
+        if (sched != NULL)
+        {
+            uint8_t  localIdx      = gCurrentStageIdx;
+            uint32_t localDelayMs  = sched->stageTimes_ms[localIdx];
 
-            if (lastPacketAvailable)
+            if (localIdx == 0) CycleAlign(sched, TicksToMs(originTick + ScheduleMsToTicks(elapsedMs)), &trimIdx, &trimMs);
+            if (localIdx == trimIdx) localDelayMs = (uint32_t)((int32_t)localDelayMs + trimMs);
+
+            ApplyStageToLEDs(&sched->stageOutputs[localIdx]);
+            showing = sched->stagesPattern[localIdx];
+            if (!firstLight)
             {
-                PrintStoredPacketOnce();
+                firstLight = 1;
+                bootToLightMs = HAL_GetTick();
+                LOG_EVENT(LOG_TOK_FIRST_LIGHT, bootToLightMs);
             }
+            prevApplyStamp = StageProbeRecord(sched, adopted, prevApplyStamp, prevStageMs);
+            prevStageMs = localDelayMs;
+            adopted = 0;
+
+            TickType_t lateTicks = xTaskGetTickCount() - (originTick + ScheduleMsToTicks(elapsedMs));
+            if (lateTicks > gStageLateMaxTicks) gStageLateMaxTicks = lateTicks;
+            if (localIdx == 0) gCycleCount++;
 
-            char msg[64];
-            snprintf(msg, sizeof(msg),"Running Stage %d, delay = %.2f s\r\n",localIdx + 1, (float)localDelayMs / 1000.0f);
-            PrintUART_Local(msg);
+            PrintStoredPacketOnce();
 
-            ApplyStageToLEDs(localPattern);
+            LOG_EVENT(LOG_TOK_RUNNING_STAGE, (uint32_t)(localIdx + 1), localDelayMs);
 
             if (localDelayMs == 0) localDelayMs = 1;
 
-            if (xStageTimer != NULL)
+            uint8_t preempted;
+            localDelayMs = RunStage(sched, localIdx, localDelayMs, originTick, elapsedMs, &busyStart, &preempted);
+            prevStageMs = localDelayMs;
+            elapsedMs += localDelayMs;
+
+            if (preempted)
             {
-                xTimerChangePeriod(xStageTimer,pdMS_TO_TICKS(localDelayMs),portMAX_DELAY);
-                xTimerStart(xStageTimer, portMAX_DELAY);
+                /* The cycle restarts at stage 1 of whichever schedule runs
+                 * next, which the exit clearance led to; CycleAlign pulls
+                 * it back into phase. */
+                showing = HoldPreemption(showing, &busyStart);
+                resumeWith = PickSchedule(1, &lastImmediate, &queueHeld);
+                showing = EndPreemption((resumeWith != NULL) ? resumeWith : sched, showing, &busyStart);
+                justResumed = 1;
+                originTick = xTaskGetTickCount();
+                elapsedMs = 0;
+                prevStageMs = 0;
+                gCurrentStageIdx = 0;
+                continue;
             }
-            else
+
+            gCurrentStageIdx = (localIdx + 1 >= sched->stageNum) ? 0 : (uint8_t)(localIdx + 1);
+        }
+        else
+        {
+            /* Nothing to run: sleep until a schedule, a preemption or the
+             * activation time of a queued schedule. */
+            ScheduleActivation_t when;
+            uint32_t at;
+            const Schedule_t *planned = ScheduleQueue_Peek(&when, &at);
+            TickType_t wait = portMAX_DELAY;
+            if (planned != NULL && when == SCHEDULE_AT_TIME_MS)
             {
-                vTaskDelay(pdMS_TO_TICKS(localDelayMs));
+                int32_t dueMs = (int32_t)(at - ControllerTimeMs());
+                wait = (dueMs > 0) ? pdMS_TO_TICKS((uint32_t)dueMs) + 1 : 1;
             }
 
-            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            uint32_t bits = 0;
+            ledTaskBusyCycles += Perf_Now() - busyStart;
+            xTaskNotifyWait(0, LED_NOTIFY_EVENTS, &bits, wait);
+            busyStart = Perf_Now();
 
-            if (xData_Mutex != NULL)
+            if ((bits & LED_NOTIFY_PREEMPT) && AcceptPreempt(NULL))
             {
-                if (xSemaphoreTake(xData_Mutex, portMAX_DELAY) == pdTRUE)
-                {
-                    gCurrentStageIdx++;
-                    if (gCurrentStageIdx >= gStageNum)
-                        gCurrentStageIdx = 0;
-                    xSemaphoreGive(xData_Mutex);
-                }
+                showing = HoldPreemption(showing, &busyStart);
+                resumeWith = PickSchedule(1, &lastImmediate, &queueHeld);
+                showing = EndPreemption(resumeWith, showing, &busyStart);
+                justResumed = 1;
             }
         }
-        else
-        {
-            vTaskDelay(pdMS_TO_TICKS(10));
-        }
     }
 }
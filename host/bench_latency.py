@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+"""Packet-in to light-out latency and stage jitter benchmark on the host sim.
+
+    FREERTOS_KERNEL=... sim/build.sh
+    ./bench_latency.py                          # 1, 5 and 10 ms packet rates
+    ./bench_latency.py --rates 1 --count 5000 --stage-ms 2
+
+For every rate a fresh sim/traffic_sim is started, fed --count packets,
+and left idle until it logs its probe histograms (probe.h). Stage times are
+overridden with --stage-ms so schedules turn over quickly; publish-to-light
+includes the wait for the next cycle boundary by design.
+"""
+import argparse
+import json
+import os
+import re
+import select
+import subprocess
+import sys
+import time
+
+from feed_packets import frame, legacy_payload
+
+PROBES = ["rx_isr", "rx_to_decode", "rx_to_publish", "publish_to_light",
+          "rx_to_light", "gpio_write", "stage_jitter", "detector_to_decision",
+          "preempt_react"]
+
+SUMMARY_RE = re.compile(r"Probe (\d+): n=(\d+) p50=(\d+) ns p99=(\d+) ns max=(\d+) ns")
+BUCKET_RE = re.compile(r"Probe (\d+) <= (\d+) ns: (\d+)")
+
+
+def start_sim(path):
+    sim = subprocess.Popen([path], stderr=subprocess.PIPE, text=True)
+    for line in sim.stderr:
+        m = re.search(r"USART6 on (\S+)", line)
+        if m:
+            return sim, m.group(1)
+    raise RuntimeError("simulator exited before opening its UART")
+
+
+def run_rate(args, pkt, rate_ms):
+    sim, tty = start_sim(args.sim)
+    fd = os.open(tty, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+    log = bytearray()
+
+    def drain(timeout):
+        r, _, _ = select.select([fd], [], [], timeout)
+        if r:
+            try:
+                log.extend(os.read(fd, 65536))
+            except BlockingIOError:
+                pass
+
+    try:
+        deadline = time.monotonic()
+        for _ in range(args.count):
+            os.write(fd, pkt)
+            deadline += rate_ms / 1000.0
+            while True:
+                left = deadline - time.monotonic()
+                if left <= 0:
+                    break
+                drain(left)
+
+        summaries, buckets = {}, {}
+        quiet_until = time.monotonic() + args.settle_s
+        while time.monotonic() < quiet_until and len(summaries) < len(PROBES):
+            drain(0.1)
+            text = log.decode("ascii", "replace")
+            summaries = {int(m.group(1)): tuple(map(int, m.groups()[1:])) for m in SUMMARY_RE.finditer(text)}
+        drain(0.5)
+        text = log.decode("ascii", "replace")
+        for m in BUCKET_RE.finditer(text):
+            buckets.setdefault(int(m.group(1)), []).append((int(m.group(2)), int(m.group(3))))
+        return summaries, buckets
+    finally:
+        os.close(fd)
+        sim.kill()
+        sim.wait()
+
+
+def histogram(rows, width=40):
+    if not rows:
+        return
+    peak = max(c for _, c in rows)
+    for upper, count in rows:
+        print("    <= %10.1f us %8d %s" % (upper / 1000.0, count, "#" * max(1, count * width // peak)))
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--sim", default=os.path.join(here, "sim", "traffic_sim"))
+    ap.add_argument("--json", default=os.path.join(here, "..", "json file"))
+    ap.add_argument("--rates", default="1,5,10", help="packet intervals in ms")
+    ap.add_argument("--count", type=int, default=2000)
+    ap.add_argument("--stage-ms", type=int, default=5, help="0 keeps the JSON stage times")
+    ap.add_argument("--settle-s", type=float, default=5.0)
+    args = ap.parse_args()
+
+    with open(args.json) as f:
+        cfg = json.load(f)
+    if args.stage_ms:
+        cfg["StageTimes"] = [args.stage_ms / 1000.0] * len(cfg["StageTimes"])
+    pkt = frame(legacy_payload(cfg))
+
+    for rate in (float(r) for r in args.rates.split(",")):
+        summaries, buckets = run_rate(args, pkt, rate)
+        print("\n=== packet every %g ms, %d packets ===" % (rate, args.count))
+        print("  %-18s %8s %12s %12s %12s" % ("probe", "n", "p50 us", "p99 us", "max us"))
+        for pid, name in enumerate(PROBES):
+            if pid not in summaries:
+                print("  %-18s %8s" % (name, "-"))
+                continue
+            n, p50, p99, mx = summaries[pid]
+            print("  %-18s %8d %12.1f %12.1f %12.1f" % (name, n, p50 / 1000.0, p99 / 1000.0, mx / 1000.0))
+        for pid in (PROBES.index("rx_to_publish"), PROBES.index("stage_jitter")):
+            print("\n  %s histogram" % PROBES[pid])
+            histogram(buckets.get(pid, []))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+"""Streams schedule packets built from the `json file` configuration.
+
+    ./feed_packets.py /dev/pts/N                       # one packet
+    ./feed_packets.py /dev/pts/N --interval-ms 5 --count 1000
+    ./feed_packets.py - --count 1 > frame.bin          # raw frame to stdout
+    ./feed_packets.py /dev/pts/N --delta-stage 3 --delta-ms 40000
+    ./feed_packets.py /dev/pts/N --compact             # PACKET_TYPE_COMPACT
+    ./feed_packets.py /dev/pts/N --at-cycle 42         # PACKET_TYPE_TIMED
+    ./feed_packets.py /dev/pts/N --preempt 2 --preempt-hold-ms 60000
+    ./feed_packets.py /dev/pts/N --preempt-clear       # PACKET_TYPE_PREEMPT
+
+Frames follow packet_codec.h: SOF | ADDR | LEN | payload | CRC-32/MPEG-2 | EOF.
+"""
+import argparse
+import json
+import os
+import struct
+import sys
+import time
+
+MAX_STAGES = 8
+ADDR_BROADCAST = 0xFF
+
+PACKET_TYPE_DELTA = 0xF2
+PACKET_TYPE_COMPACT = 0xF3
+PACKET_TYPE_TIMED = 0xF4
+PACKET_TYPE_PREEMPT = 0xF6
+PREEMPT_CLEAR, PREEMPT_START = 0, 1
+ACTIVATE_CYCLE, ACTIVATE_TIME_MS = 0, 1
+COMPACT_VERSION = 2
+OFFSET_KEYS = ("offset_tol", "offset_maxDed", "offset_maxExt", "offset_phase")
+DELTA_TIME, DELTA_PATTERN, DELTA_STAGE_NUM = 0x01, 0x02, 0x04
+
+
+def crc32_mpeg2(data):
+    crc = 0xFFFFFFFF
+    for b in data:
+        crc ^= b << 24
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x04C11DB7) if crc & 0x80000000 else (crc << 1)
+            crc &= 0xFFFFFFFF
+    return crc
+
+
+def stage_pattern(row):
+    # Element k of a Stages row drives signal bit 11-k.
+    bits = 0
+    for k, on in enumerate(row):
+        if on:
+            bits |= 1 << (11 - k)
+    return bits
+
+
+def legacy_payload(cfg):
+    times = [int(round(t * 1000)) for t in cfg["StageTimes"]][:MAX_STAGES]
+    stages = [stage_pattern(r) for r in cfg["Stages"]][:MAX_STAGES]
+    times += [0] * (MAX_STAGES - len(times))
+    stages += [0] * (MAX_STAGES - len(stages))
+    return (struct.pack(">BB", cfg["StageNum"], cfg["MaxLight"])
+            + struct.pack(">8I", *times)
+            + struct.pack(">8I", *stages)
+            + struct.pack(">BB", cfg["green_Ext"] & 0xFF, cfg["Interrupt"] & 0xFF))
+
+
+def varint(v):
+    out = bytearray()
+    while True:
+        b = v & 0x7F
+        v >>= 7
+        if v:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return bytes(out)
+
+
+def compact_payload(cfg):
+    # Version 1 when the JSON has no offset_* limits to carry.
+    n = cfg["StageNum"]
+    width = cfg["MaxLight"]
+    version = COMPACT_VERSION if any(k in cfg for k in OFFSET_KEYS) else 1
+    out = bytearray([PACKET_TYPE_COMPACT, version, n, width,
+                     cfg["green_Ext"] & 0xFF, cfg["Interrupt"] & 0xFF])
+    for t in cfg["StageTimes"][:n]:
+        out += varint(int(round(t * 1000)))
+    bits = 0
+    for row in cfg["Stages"][:n]:
+        bits = (bits << width) | stage_pattern(row)
+    nbits = n * width
+    pad = -nbits % 8
+    out += (bits << pad).to_bytes((nbits + pad) // 8, "big")
+    if version >= 2:
+        for k in OFFSET_KEYS:
+            out += varint(int(round(cfg.get(k, 0) * 1000)))
+    return bytes(out)
+
+
+def timed_payload(when, at, schedule_payload):
+    """Queue schedule_payload until cycle number `at` or controller ms `at`."""
+    return struct.pack(">BBI", PACKET_TYPE_TIMED, when, at & 0xFFFFFFFF) + schedule_payload
+
+
+def preempt_payload(pattern=None, hold_ms=0):
+    """START holding pattern for up to hold_ms (0: the firmware's limit), or CLEAR."""
+    if pattern is None:
+        return struct.pack(">BB", PACKET_TYPE_PREEMPT, PREEMPT_CLEAR)
+    return struct.pack(">BBII", PACKET_TYPE_PREEMPT, PREEMPT_START, pattern, hold_ms)
+
+
+def delta_payload(first, times_ms=None, patterns=None, stage_num=None):
+    """Patch stages first.. with the given durations and/or pattern rows."""
+    count = len(times_ms if times_ms is not None else patterns)
+    flags = ((DELTA_TIME if times_ms is not None else 0)
+             | (DELTA_PATTERN if patterns is not None else 0)
+             | (DELTA_STAGE_NUM if stage_num is not None else 0))
+    out = bytearray([PACKET_TYPE_DELTA, flags, first, count])
+    if stage_num is not None:
+        out.append(stage_num)
+    for i in range(count):
+        if times_ms is not None:
+            out += varint(times_ms[i])
+        if patterns is not None:
+            out += struct.pack(">H", stage_pattern(patterns[i]))
+    return bytes(out)
+
+
+def frame(payload, addr=ADDR_BROADCAST):
+    body = struct.pack(">BH", addr, len(payload)) + payload
+    return b"SOF" + body + struct.pack(">I", crc32_mpeg2(body)) + b"EOF"
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("tty", help="serial device or pty slave; '-' for stdout")
+    ap.add_argument("--json", default=os.path.join(here, "..", "json file"))
+    ap.add_argument("--interval-ms", type=float, default=10.0)
+    ap.add_argument("--count", type=int, default=1)
+    ap.add_argument("--addr", type=lambda v: int(v, 0), default=ADDR_BROADCAST,
+                    help="destination: unit 0x01-0xEF, group 0xF0-0xFE, broadcast 0xFF")
+    ap.add_argument("--compact", action="store_true", help="use the compact encoding")
+    ap.add_argument("--baud", type=int, default=115200, help="for the time-on-wire report")
+    ap.add_argument("--at-cycle", type=int, help="activate at the start of this cycle number")
+    ap.add_argument("--at-ms", type=int, help="activate at this controller time (ms)")
+    ap.add_argument("--delta-stage", type=int, help="send a delta for this stage (1-based)")
+    ap.add_argument("--delta-ms", type=int, help="new duration for --delta-stage")
+    ap.add_argument("--preempt", type=int, metavar="STAGE",
+                    help="preempt to this stage's pattern from --json (1-based)")
+    ap.add_argument("--preempt-hold-ms", type=int, default=0, help="0: the firmware's limit")
+    ap.add_argument("--preempt-clear", action="store_true", help="end a preemption")
+    args = ap.parse_args()
+
+    if args.preempt_clear:
+        pkt = frame(preempt_payload(), args.addr)
+    elif args.preempt:
+        with open(args.json) as f:
+            cfg = json.load(f)
+        pattern = stage_pattern(cfg["Stages"][args.preempt - 1])
+        pkt = frame(preempt_payload(pattern, args.preempt_hold_ms), args.addr)
+    elif args.delta_stage:
+        pkt = frame(delta_payload(args.delta_stage - 1, times_ms=[args.delta_ms]), args.addr)
+    else:
+        with open(args.json) as f:
+            cfg = json.load(f)
+        payload = compact_payload(cfg) if args.compact else legacy_payload(cfg)
+        if args.at_cycle is not None:
+            payload = timed_payload(ACTIVATE_CYCLE, args.at_cycle, payload)
+        elif args.at_ms is not None:
+            payload = timed_payload(ACTIVATE_TIME_MS, args.at_ms, payload)
+        pkt = frame(payload, args.addr)
+
+    if args.tty == "-":
+        out = open(sys.stdout.fileno(), "wb", buffering=0, closefd=False)
+    else:
+        out = open(os.open(args.tty, os.O_WRONLY | os.O_NOCTTY), "wb", buffering=0)
+
+    period = args.interval_ms / 1000.0
+    deadline = time.monotonic()
+    for _ in range(args.count):
+        out.write(pkt)
+        deadline += period
+        delay = deadline - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+
+    sys.stderr.write("sent %d x %d bytes (%.2f ms each at %d baud, 8N1)\n"
+                     % (args.count, len(pkt), len(pkt) * 10 * 1000.0 / args.baud, args.baud))
+
+
+if __name__ == "__main__":
+    main()
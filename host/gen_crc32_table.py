@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+"""Writes crc32_table.h, the slice-by-4 tables of the software CRC-32/MPEG-2.
+
+    ./gen_crc32_table.py > ../crc32_table.h
+
+crcTable[0] is the bytewise table; crcTable[k][i] is the CRC of byte i
+followed by k zero bytes, so crc32.c can fold four bytes per step. The
+tables are const and live in flash.
+"""
+POLY = 0x04C11DB7
+
+
+def byte_table():
+    table = []
+    for i in range(256):
+        c = i << 24
+        for _ in range(8):
+            c = ((c << 1) ^ POLY) if c & 0x80000000 else (c << 1)
+            c &= 0xFFFFFFFF
+        table.append(c)
+    return table
+
+
+def main():
+    tables = [byte_table()]
+    for _ in range(1, 4):
+        prev = tables[-1]
+        tables.append([((p << 8) & 0xFFFFFFFF) ^ tables[0][p >> 24] for p in prev])
+
+    print("/* Generated by host/gen_crc32_table.py; do not edit. */")
+    print("#ifndef CRC32_TABLE_H")
+    print("#define CRC32_TABLE_H")
+    print()
+    print("static const uint32_t crcTable[4][256] =")
+    print("{")
+    for k, table in enumerate(tables):
+        print("    {")
+        for row in range(0, 256, 6):
+            words = ", ".join("0x%08Xu" % w for w in table[row:row + 6])
+            print("        %s%s" % (words, "," if row + 6 < 256 else ""))
+        print("    }%s" % ("," if k < 3 else ""))
+    print("};")
+    print()
+    print("#endif")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,106 @@
+/*
+ * Turns the tokenized log stream (firmware built with LOG_TOKENIZED=1)
+ * back into the text the firmware prints in its default mode.
+ *
+ *   cc -O2 -I.. log_decode.c ../log_format.c -o log_decode
+ *   ./log_decode /dev/ttyUSB0        (or a capture file, or stdin)
+ */
+#include "log_format.h"
+
+#include <stdio.h>
+#include <stdint.h>
+
+typedef enum
+{
+    DEC_SYNC = 0,
+    DEC_TOKEN,
+    DEC_ARGS
+} DecodeState_t;
+
+typedef struct
+{
+    DecodeState_t state;
+    LogToken_t    tok;
+    uint8_t       argc;
+    uint8_t       shift;
+    uint32_t      argv[LOG_MAX_ARGS];
+    uint32_t      records;
+    uint32_t      bytes;
+} LogDecoder_t;
+
+static void EmitRecord(LogDecoder_t *d)
+{
+    char text[LOG_MAX_TEXT];
+    LogFormat_Render(text, sizeof(text), LogFormat_Table[d->tok].fmt, d->argv, d->argc);
+    fputs(text, stdout);
+    d->records++;
+    d->state = DEC_SYNC;
+}
+
+static void Decode(LogDecoder_t *d, uint8_t b)
+{
+    d->bytes++;
+
+    switch (d->state)
+    {
+    case DEC_SYNC:
+        if (b == LOG_TOKEN_SYNC) d->state = DEC_TOKEN;
+        break;
+
+    case DEC_TOKEN:
+        if (b >= LOG_TOK_COUNT)
+        {
+            d->state = (b == LOG_TOKEN_SYNC) ? DEC_TOKEN : DEC_SYNC;
+            break;
+        }
+        d->tok = (LogToken_t)b;
+        d->argc = 0;
+        d->shift = 0;
+        d->argv[0] = 0;
+        if (LogFormat_Table[d->tok].argc == 0)
+            EmitRecord(d);
+        else
+            d->state = DEC_ARGS;
+        break;
+
+    case DEC_ARGS:
+        d->argv[d->argc] |= (uint32_t)(b & 0x7Fu) << d->shift;
+        if (b & 0x80u)
+        {
+            d->shift += 7;
+            if (d->shift > 28) d->state = DEC_SYNC;
+            break;
+        }
+        d->shift = 0;
+        if (++d->argc >= LogFormat_Table[d->tok].argc)
+            EmitRecord(d);
+        else
+            d->argv[d->argc] = 0;
+        break;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in = stdin;
+    if (argc > 1)
+    {
+        in = fopen(argv[1], "rb");
+        if (in == NULL)
+        {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    LogDecoder_t dec = { 0 };
+    int c;
+    while ((c = fgetc(in)) != EOF)
+    {
+        Decode(&dec, (uint8_t)c);
+        if (dec.state == DEC_SYNC) fflush(stdout);
+    }
+
+    fprintf(stderr, "%u records from %u bytes\n", (unsigned)dec.records, (unsigned)dec.bytes);
+    return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * Many controllers on one shared bus: how much receive-side CPU each one
+ * spends as the bus fills up, with address filtering in the byte parser
+ * (what the firmware does) versus filtering after CRC and decode.
+ *
+ *   cc -O2 -I.. multidrop_sim.c ../packet_codec.c ../crc32.c -o multidrop_sim
+ *   ./multidrop_sim [controllers]
+ *
+ * Controller 1 gets OWN_FRAMES_PER_S schedules per second, every controller
+ * is in group 0, which gets one frame per second, and the rest of the bus
+ * up to the given utilisation of BUS_BAUD carries schedules for the other
+ * controllers. "handed/s" is the number of frames per second that would be
+ * queued to StartPacketProcessor and wake it.
+ */
+#include "packet_codec.h"
+#include "crc32.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define BUS_BAUD          115200u
+#define BUS_BYTES_PER_S   (BUS_BAUD / 10u)
+#define SIM_SECONDS       20u
+#define OWN_FRAMES_PER_S  10u
+#define MAX_CONTROLLERS   PACKET_ADDR_UNIT_MAX
+
+typedef struct
+{
+    double   cpuSeconds;
+    uint32_t handed;
+    uint32_t accepted;
+} RxCost_t;
+
+static uint8_t stream[SIM_SECONDS * BUS_BYTES_PER_S + PACKET_WIRE_LEN(PACKET_MAX_PAYLOAD)];
+
+static double NowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint16_t BuildLegacyPayload(uint8_t *p, uint32_t seed)
+{
+    memset(p, 0, PACKET_LEGACY_PAYLOAD_LEN);
+    p[0] = PACKET_LEGACY_STAGES;
+    p[1] = 12;
+    for (int i = 0; i < PACKET_LEGACY_STAGES; i++)
+    {
+        uint32_t ms = 5000u + (seed * 7919u + (uint32_t)i * 104729u) % 40000u;
+        p[2 + 4 * i + 2] = (uint8_t)(ms >> 8);
+        p[2 + 4 * i + 3] = (uint8_t)ms;
+        p[2 + 4 * PACKET_LEGACY_STAGES + 4 * i + 3] = (uint8_t)(1u << (i % 8));
+    }
+    return PACKET_LEGACY_PAYLOAD_LEN;
+}
+
+/* Lays out SIM_SECONDS of bus traffic at the given utilisation. */
+static uint32_t BuildStream(uint32_t controllers, uint32_t utilPct)
+{
+    uint8_t payload[PACKET_MAX_PAYLOAD];
+    uint16_t payloadLen = BuildLegacyPayload(payload, 1);
+    const uint32_t frameLen = PACKET_WIRE_LEN(payloadLen);
+    const uint32_t framesPerS = BUS_BYTES_PER_S * utilPct / 100u / frameLen;
+
+    uint32_t len = 0;
+    uint32_t rng = 12345u;
+    for (uint32_t s = 0; s < SIM_SECONDS; s++)
+    {
+        for (uint32_t f = 0; f < framesPerS; f++)
+        {
+            uint8_t addr;
+            if (f < OWN_FRAMES_PER_S)
+            {
+                addr = 1;
+            }
+            else if (f == OWN_FRAMES_PER_S)
+            {
+                addr = PACKET_ADDR_GROUP(0);
+            }
+            else
+            {
+                rng = rng * 1103515245u + 12345u;
+                addr = (uint8_t)(2u + (rng >> 16) % (controllers - 1u));
+            }
+            payloadLen = BuildLegacyPayload(payload, rng);
+            len += PacketCodec_Encode(addr, payload, payloadLen, &stream[len]);
+        }
+    }
+    return len;
+}
+
+static RxCost_t Receive(uint8_t address, int filterInParser, uint32_t streamLen)
+{
+    static PacketCodec_t codec;
+    static uint8_t frame[PACKET_MAX_FRAME];
+    RxCost_t cost = { 0 };
+    PacketSchedule_t pkt;
+
+    PacketCodec_Init(&codec, filterInParser ? address : PACKET_ADDR_MONITOR, 0x0001);
+    PacketCodec_SetBuffer(&codec, frame);
+    PacketCodec_t self;
+    PacketCodec_Init(&self, address, 0x0001);
+
+    double t0 = NowSeconds();
+    for (uint32_t i = 0; i < streamLen; i++)
+    {
+        if (PacketCodec_PushByte(&codec, stream[i]) != PACKET_FRAME) continue;
+
+        cost.handed++;
+        uint16_t frameLen = PacketCodec_FrameLen(&codec);
+        if (!PacketCodec_Verify(codec.frame, frameLen)) continue;
+        if (!PacketCodec_Decode(&codec.frame[PACKET_HEADER_LEN], codec.length, &pkt)) continue;
+        if (!PacketCodec_AddressMatch(&self, codec.frame[0])) continue;
+        cost.accepted++;
+    }
+    cost.cpuSeconds = NowSeconds() - t0;
+    return cost;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t controllers = (argc > 1) ? (uint32_t)atoi(argv[1]) : 32u;
+    if (controllers < 2 || controllers > MAX_CONTROLLERS) controllers = 32;
+
+    static const uint32_t utilPct[] = { 10, 25, 50, 75, 100 };
+
+    Crc32_Init();
+    printf("%u controllers, %u baud bus, %u own frames/s for each measured unit\n\n",
+           (unsigned)controllers, (unsigned)BUS_BAUD, (unsigned)OWN_FRAMES_PER_S);
+    printf("bus%%  frames/s | parser filter: handed/s  us/s mean  us/s max | after decode: handed/s  us/s mean\n");
+
+    for (uint32_t u = 0; u < sizeof(utilPct) / sizeof(utilPct[0]); u++)
+    {
+        uint32_t streamLen = BuildStream(controllers, utilPct[u]);
+        uint32_t framesPerS = BUS_BYTES_PER_S * utilPct[u] / 100u / PACKET_WIRE_LEN(PACKET_LEGACY_PAYLOAD_LEN);
+
+        double earlySum = 0, earlyMax = 0, lateSum = 0;
+        uint32_t earlyHanded = 0, lateHanded = 0;
+        for (uint32_t c = 1; c <= controllers; c++)
+        {
+            RxCost_t early = Receive((uint8_t)c, 1, streamLen);
+            RxCost_t late = Receive((uint8_t)c, 0, streamLen);
+            double earlyUs = early.cpuSeconds * 1e6 / SIM_SECONDS;
+            earlySum += earlyUs;
+            if (earlyUs > earlyMax) earlyMax = earlyUs;
+            lateSum += late.cpuSeconds * 1e6 / SIM_SECONDS;
+            if (c == 1)
+            {
+                earlyHanded = early.handed;
+                lateHanded = late.handed;
+            }
+        }
+
+        printf("%3u%%  %8u | %22u  %10.1f  %8.1f | %21u  %10.1f\n",
+               (unsigned)utilPct[u], (unsigned)framesPerS,
+               (unsigned)(earlyHanded / SIM_SECONDS), earlySum / controllers, earlyMax,
+               (unsigned)(lateHanded / SIM_SECONDS), lateSum / controllers);
+    }
+    return 0;
+}
@@ -0,0 +1,16 @@
+#!/bin/sh
+# Builds the Raspberry Pi encoder/streamer. The firmware codec is linked in
+# for `pi_encoder verify`.
+set -e
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$HERE/../..
+OBJ=${TMPDIR:-/tmp}/pi_encoder.$$
+mkdir -p "$OBJ"
+trap 'rm -rf "$OBJ"' EXIT
+
+${CC:-cc} -std=c11 -O2 -c -I"$ROOT" "$ROOT/packet_codec.c" -o "$OBJ/packet_codec.o"
+${CC:-cc} -std=c11 -O2 -c -I"$ROOT" "$ROOT/crc32.c" -o "$OBJ/crc32.o"
+${CXX:-c++} -std=c++17 -O2 -Wall -Wextra -I"$HERE" -I"$ROOT" \
+    "$HERE/pi_encoder.cpp" "$HERE/schedule_json.cpp" "$HERE/frame_encoder.cpp" \
+    "$OBJ/packet_codec.o" "$OBJ/crc32.o" -o "$HERE/pi_encoder"
@@ -0,0 +1,153 @@
+#include "frame_encoder.hpp"
+
+#include <cstring>
+
+namespace pi
+{
+
+namespace
+{
+
+constexpr uint8_t kTypeCompact = 0xF3;
+constexpr uint8_t kTypeTimed = 0xF4;
+constexpr size_t  kTimedHeader = 6;
+constexpr uint8_t kCompactVersion = 2;   // 1 when there are no offset_* limits
+constexpr int     kLegacyStages = 8;
+
+struct CrcTable
+{
+    uint32_t t[256];
+
+    constexpr CrcTable() : t()
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i << 24;
+            for (int b = 0; b < 8; b++) c = (c & 0x80000000u) ? (c << 1) ^ 0x04C11DB7u : (c << 1);
+            t[i] = c;
+        }
+    }
+};
+
+constexpr CrcTable kCrc;
+
+inline uint8_t *PutU32BE(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+    return p + 4;
+}
+
+inline uint8_t *PutVarint(uint8_t *p, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+} // namespace
+
+uint32_t Crc32Mpeg2(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    while (len--) crc = (crc << 8) ^ kCrc.t[(crc >> 24) ^ *data++];
+    return crc;
+}
+
+size_t FrameEncoder::Finish(uint8_t addr, size_t payloadLen)
+{
+    buf_[0] = 'S';
+    buf_[1] = 'O';
+    buf_[2] = 'F';
+    buf_[3] = addr;
+    buf_[4] = (uint8_t)(payloadLen >> 8);
+    buf_[5] = (uint8_t)payloadLen;
+
+    uint8_t *p = PutU32BE(&buf_[6 + payloadLen], Crc32Mpeg2(&buf_[3], 3 + payloadLen));
+    p[0] = 'E';
+    p[1] = 'O';
+    p[2] = 'F';
+    return (size_t)(p + 3 - buf_);
+}
+
+size_t FrameEncoder::EncodeLegacy(const Schedule &s, uint8_t addr)
+{
+    if (s.stageNum > kLegacyStages) return 0;
+
+    uint8_t *p = Payload();
+    *p++ = s.stageNum;
+    *p++ = s.maxLight;
+    for (int i = 0; i < kLegacyStages; i++) p = PutU32BE(p, (i < s.timeCount) ? s.stageTimesMs[i] : 0);
+    for (int i = 0; i < kLegacyStages; i++) p = PutU32BE(p, (i < s.patternCount) ? s.patterns[i] : 0);
+    *p++ = s.greenExt;
+    *p++ = s.interrupt;
+    return Finish(addr, (size_t)(p - Payload()));
+}
+
+size_t FrameEncoder::EncodeCompact(const Schedule &s, uint8_t addr)
+{
+    const int width = s.maxLight;
+    if (width == 0 || width > 32) return 0;
+    if (6 + 5 * (size_t)s.stageNum + ((size_t)s.stageNum * width + 7) / 8 + 4 * 5 > kMaxPayload) return 0;
+
+    uint8_t *p = Payload();
+    *p++ = kTypeCompact;
+    *p++ = s.hasOffsets ? kCompactVersion : 1;
+    *p++ = s.stageNum;
+    *p++ = s.maxLight;
+    *p++ = s.greenExt;
+    *p++ = s.interrupt;
+    for (int i = 0; i < s.stageNum; i++) p = PutVarint(p, s.stageTimesMs[i]);
+
+    uint64_t acc = 0;
+    int bits = 0;
+    for (int i = 0; i < s.stageNum; i++)
+    {
+        acc = (acc << width) | (s.patterns[i] & (width == 32 ? 0xFFFFFFFFu : ((1u << width) - 1u)));
+        bits += width;
+        while (bits >= 8)
+        {
+            bits -= 8;
+            *p++ = (uint8_t)(acc >> bits);
+        }
+    }
+    if (bits > 0) *p++ = (uint8_t)(acc << (8 - bits));
+
+    if (s.hasOffsets)
+    {
+        p = PutVarint(p, s.offsetTolMs);
+        p = PutVarint(p, s.offsetMaxDedMs);
+        p = PutVarint(p, s.offsetMaxExtMs);
+        p = PutVarint(p, s.offsetPhaseMs);
+    }
+    return Finish(addr, (size_t)(p - Payload()));
+}
+
+size_t FrameEncoder::MakeTimed(size_t frameLen, uint8_t when, uint32_t at)
+{
+    if (frameLen == 0) return 0;
+    size_t inner = ((size_t)buf_[4] << 8) | buf_[5];
+    if (inner + kTimedHeader > kMaxPayload) return 0;
+
+    std::memmove(Payload() + kTimedHeader, Payload(), inner);
+    uint8_t *p = Payload();
+    *p++ = kTypeTimed;
+    *p++ = when;
+    PutU32BE(p, at);
+    return Finish(buf_[3], inner + kTimedHeader);
+}
+
+size_t FrameEncoder::EncodeRaw(const uint8_t *payload, size_t len, uint8_t addr)
+{
+    if (len == 0 || len > kMaxPayload) return 0;
+    std::memcpy(Payload(), payload, len);
+    return Finish(addr, len);
+}
+
+} // namespace pi
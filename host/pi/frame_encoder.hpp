@@ -0,0 +1,55 @@
+#ifndef PI_FRAME_ENCODER_HPP
+#define PI_FRAME_ENCODER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "schedule_json.hpp"
+
+namespace pi
+{
+
+/*
+ * Builds controller frames (packet_codec.h) into one buffer owned by the
+ * encoder, so steady-state encoding allocates nothing. The returned frame
+ * stays valid until the next Encode call.
+ *
+ *   'S' 'O' 'F' | ADDR | LEN_HI LEN_LO | PAYLOAD | CRC-32/MPEG-2 | 'E' 'O' 'F'
+ */
+class FrameEncoder
+{
+public:
+    static constexpr uint8_t  kAddrBroadcast = 0xFF;
+    static constexpr size_t   kMaxPayload = 256;
+    static constexpr size_t   kMaxFrame = 3 + 3 + kMaxPayload + 4 + 3;
+
+    /* Fixed 8-stage layout; 0 if the schedule has more than 8 stages. */
+    size_t EncodeLegacy(const Schedule &s, uint8_t addr);
+
+    /* PACKET_TYPE_COMPACT layout; 0 if it does not fit one frame. */
+    size_t EncodeCompact(const Schedule &s, uint8_t addr);
+
+    /* Wraps the frame just encoded (legacy or compact) as PACKET_TYPE_TIMED,
+     * activating at cycle number `at` (kActivateCycle) or controller ms
+     * (kActivateTimeMs). Returns 0 if it no longer fits. */
+    static constexpr uint8_t kActivateCycle = 0;
+    static constexpr uint8_t kActivateTimeMs = 1;
+    size_t MakeTimed(size_t frameLen, uint8_t when, uint32_t at);
+
+    /* Any payload (delta, stats query, ...). */
+    size_t EncodeRaw(const uint8_t *payload, size_t len, uint8_t addr);
+
+    const uint8_t *Data() const { return buf_; }
+
+private:
+    uint8_t *Payload() { return &buf_[6]; }
+    size_t Finish(uint8_t addr, size_t payloadLen);
+
+    uint8_t buf_[kMaxFrame];
+};
+
+uint32_t Crc32Mpeg2(const uint8_t *data, size_t len);
+
+} // namespace pi
+
+#endif
@@ -0,0 +1,387 @@
+/*
+ * Raspberry Pi side: turns controller JSON into frames and sends them.
+ *
+ *   ./build.sh
+ *   ./pi_encoder stream "../../json file" /dev/ttyAMA0 --interval-us 1000 --count 10000
+ *   ./pi_encoder stream plans.jsonl /dev/ttyAMA0 --count 3 --at-cycle 100
+ *   ./pi_encoder bulk schedules.jsonl frames.bin [--compact]
+ *   ./pi_encoder bench "../../json file" [--compact]
+ *   ./pi_encoder verify schedules.jsonl
+ *
+ * Input files hold one JSON object, or one per line (JSON Lines). They are
+ * read into memory once; after that parsing and encoding do not allocate.
+ * verify runs every encoded frame through the firmware's packet_codec.c and
+ * checks that it decodes back to the parsed schedule.
+ */
+#include "frame_encoder.hpp"
+#include "schedule_json.hpp"
+
+extern "C"
+{
+#include "packet_codec.h"
+#include "crc32.h"
+}
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace
+{
+
+struct Options
+{
+    bool     compact = false;
+    uint8_t  addr = pi::FrameEncoder::kAddrBroadcast;
+    long     intervalUs = 1000;
+    long     count = 1;
+    long     iterations = 1000000;
+    speed_t  baud = B115200;
+    bool     timed = false;
+    uint8_t  when = 0;
+    uint32_t at = 0;
+};
+
+double NowSeconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+bool ReadFile(const char *path, std::vector<char> &out)
+{
+    FILE *f = std::fopen(path, "rb");
+    if (f == nullptr) return false;
+    char chunk[65536];
+    size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0) out.insert(out.end(), chunk, chunk + n);
+    std::fclose(f);
+    return true;
+}
+
+/* Calls fn(schedule) for every object in text; returns the count, -1 on a
+ * parse error. */
+template <typename Fn>
+long ForEachSchedule(const std::vector<char> &text, Fn fn)
+{
+    const char *p = text.data();
+    const char *end = p + text.size();
+    long n = 0;
+    pi::Schedule s;
+
+    for (;;)
+    {
+        while (p < end && *p != '{') p++;
+        if (p >= end) return n;
+        const char *next = pi::ParseSchedule(p, end, s);
+        if (next == nullptr)
+        {
+            std::fprintf(stderr, "parse error in schedule %ld\n", n + 1);
+            return -1;
+        }
+        fn(s);
+        n++;
+        p = next;
+    }
+}
+
+/* With --at-cycle/--at-ms the i-th frame activates at cycle (at + i) or
+ * controller time at; the Pi can then send a batch of plans ahead. */
+size_t Encode(pi::FrameEncoder &enc, const pi::Schedule &s, const Options &opt, long i = 0)
+{
+    size_t len = opt.compact ? enc.EncodeCompact(s, opt.addr) : enc.EncodeLegacy(s, opt.addr);
+    if (!opt.timed) return len;
+    uint32_t at = (opt.when == pi::FrameEncoder::kActivateCycle) ? opt.at + (uint32_t)i : opt.at;
+    return enc.MakeTimed(len, opt.when, at);
+}
+
+int OpenOutput(const char *path, const Options &opt)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_NOCTTY, 0644);
+    if (fd < 0) return -1;
+
+    termios tio;
+    if (isatty(fd) && tcgetattr(fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, opt.baud);
+        cfsetospeed(&tio, opt.baud);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+bool WriteAll(int fd, const uint8_t *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+/* Sends the schedules in a round robin on an absolute-deadline clock, so the
+ * rate does not drift with write() time; late sends are counted. */
+int CmdStream(const std::vector<char> &text, const char *outPath, const Options &opt)
+{
+    std::vector<pi::Schedule> schedules;
+    if (ForEachSchedule(text, [&](const pi::Schedule &s) { schedules.push_back(s); }) <= 0) return 1;
+
+    int fd = OpenOutput(outPath, opt);
+    if (fd < 0)
+    {
+        std::perror(outPath);
+        return 1;
+    }
+
+    pi::FrameEncoder enc;
+    timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    long late = 0;
+    size_t bytes = 0;
+    double t0 = NowSeconds();
+
+    for (long i = 0; i < opt.count; i++)
+    {
+        size_t len = Encode(enc, schedules[(size_t)i % schedules.size()], opt, i);
+        if (len == 0 || !WriteAll(fd, enc.Data(), len))
+        {
+            std::fprintf(stderr, "send failed at frame %ld\n", i);
+            close(fd);
+            return 1;
+        }
+        bytes += len;
+
+        next.tv_nsec += opt.intervalUs * 1000;
+        while (next.tv_nsec >= 1000000000L)
+        {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > next.tv_sec || (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec)) late++;
+        else clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+    }
+
+    double dt = NowSeconds() - t0;
+    close(fd);
+    std::fprintf(stderr, "sent %ld frames, %zu bytes in %.3f s (%.1f frames/s), %ld late\n",
+                 opt.count, bytes, dt, opt.count / dt, late);
+    return 0;
+}
+
+int CmdBulk(const std::vector<char> &text, const char *outPath, const Options &opt)
+{
+    std::vector<uint8_t> out;
+    out.reserve(text.size());
+    pi::FrameEncoder enc;
+    bool ok = true;
+
+    double t0 = NowSeconds();
+    long n = ForEachSchedule(text, [&](const pi::Schedule &s)
+    {
+        size_t len = Encode(enc, s, opt);
+        if (len == 0) ok = false;
+        out.insert(out.end(), enc.Data(), enc.Data() + len);
+    });
+    double dt = NowSeconds() - t0;
+    if (n < 0 || !ok) return 1;
+
+    FILE *f = std::fopen(outPath, "wb");
+    if (f == nullptr || std::fwrite(out.data(), 1, out.size(), f) != out.size())
+    {
+        std::perror(outPath);
+        return 1;
+    }
+    std::fclose(f);
+
+    std::fprintf(stderr, "%ld schedules -> %zu bytes in %.3f s (%.0f schedules/s)\n", n, out.size(), dt, n / dt);
+    return 0;
+}
+
+int CmdBench(const std::vector<char> &text, const Options &opt)
+{
+    const char *begin = text.data();
+    const char *end = begin + text.size();
+    while (begin < end && *begin != '{') begin++;
+
+    pi::Schedule s;
+    pi::FrameEncoder enc;
+    if (pi::ParseSchedule(begin, end, s) == nullptr) return 1;
+
+    volatile size_t sink = 0;
+    double t0 = NowSeconds();
+    for (long i = 0; i < opt.iterations; i++) pi::ParseSchedule(begin, end, s);
+    double tParse = NowSeconds() - t0;
+
+    t0 = NowSeconds();
+    for (long i = 0; i < opt.iterations; i++) sink = sink + Encode(enc, s, opt);
+    double tEncode = NowSeconds() - t0;
+
+    size_t frameLen = Encode(enc, s, opt);
+    std::printf("%-8s %4zu B frame  parse %7.1f ns  encode %7.1f ns  total %9.0f schedules/s\n",
+                opt.compact ? "compact" : "legacy", frameLen,
+                tParse * 1e9 / opt.iterations, tEncode * 1e9 / opt.iterations,
+                opt.iterations / (tParse + tEncode));
+    return 0;
+}
+
+/* The offset_* limits travel in compact frames only. */
+bool SameSchedule(const pi::Schedule &s, const PacketSchedule_t &d, bool compact)
+{
+    if (d.stageNum != s.stageNum || d.maxLight != s.maxLight || d.greenExt != s.greenExt || d.interrupt != s.interrupt) return false;
+    if (compact && (d.offsetTol_ms != s.offsetTolMs || d.offsetMaxDed_ms != s.offsetMaxDedMs ||
+                    d.offsetMaxExt_ms != s.offsetMaxExtMs || d.offsetPhase_ms != s.offsetPhaseMs)) return false;
+    for (int i = 0; i < s.stageNum; i++)
+    {
+        if (d.stageTimes_ms[i] != s.stageTimesMs[i] || d.stages[i] != s.patterns[i]) return false;
+    }
+    return true;
+}
+
+/* Pushes a frame through the firmware codec byte by byte, as the RX ISR
+ * does, and decodes it. */
+bool FirmwareDecodes(const uint8_t *frame, size_t len, const pi::Schedule &s, bool compact)
+{
+    static PacketCodec_t codec;
+    static uint8_t buf[PACKET_MAX_FRAME];
+    PacketCodec_Init(&codec, PACKET_ADDR_MONITOR, 0);
+    PacketCodec_SetBuffer(&codec, buf);
+
+    for (size_t i = 0; i < len; i++)
+    {
+        PacketCodecResult_t r = PacketCodec_PushByte(&codec, frame[i]);
+        if (r == PACKET_FRAME && i == len - 1)
+        {
+            const uint8_t *payload = &codec.frame[PACKET_HEADER_LEN];
+            PacketSchedule_t d;
+            if (!PacketCodec_Verify(codec.frame, PacketCodec_FrameLen(&codec))) return false;
+            if (PacketCodec_Type(payload, codec.length) == PACKET_TYPE_TIMED)
+            {
+                uint8_t when;
+                uint32_t at;
+                return PacketCodec_DecodeTimed(payload, codec.length, &when, &at, &d) && SameSchedule(s, d, compact);
+            }
+            return PacketCodec_Decode(payload, codec.length, &d) && SameSchedule(s, d, compact);
+        }
+        if (r != PACKET_NONE) return false;
+    }
+    return false;
+}
+
+int CmdVerify(const std::vector<char> &text, const Options &opt)
+{
+    Crc32_Init();
+    pi::FrameEncoder enc;
+    long failures = 0;
+    long checked = 0;
+
+    long n = ForEachSchedule(text, [&](const pi::Schedule &s)
+    {
+        for (int kind = 0; kind < 4; kind++)
+        {
+            bool compact = kind & 1;
+            size_t len = compact ? enc.EncodeCompact(s, opt.addr) : enc.EncodeLegacy(s, opt.addr);
+            if (kind & 2) len = enc.MakeTimed(len, pi::FrameEncoder::kActivateCycle, (uint32_t)checked);
+            if (len == 0) continue;
+            checked++;
+            if (!FirmwareDecodes(enc.Data(), len, s, compact))
+            {
+                failures++;
+                std::fprintf(stderr, "schedule %ld: %s%s frame does not decode to the same schedule\n",
+                             checked, (kind & 2) ? "timed " : "", compact ? "compact" : "legacy");
+            }
+        }
+    });
+    if (n < 0) return 1;
+
+    std::printf("%ld schedules, %ld frames checked against packet_codec.c, %ld mismatches\n", n, checked, failures);
+    return failures == 0 ? 0 : 1;
+}
+
+speed_t BaudFlag(long baud)
+{
+    switch (baud)
+    {
+    case 9600:    return B9600;
+    case 57600:   return B57600;
+    case 230400:  return B230400;
+    case 460800:  return B460800;
+    case 921600:  return B921600;
+    case 1000000: return B1000000;
+    default:      return B115200;
+    }
+}
+
+int Usage()
+{
+    std::fprintf(stderr,
+                 "usage: pi_encoder stream <json> <tty|file> [--interval-us N] [--count N] [--baud N]\n"
+                 "       pi_encoder bulk <jsonl> <out.bin>\n"
+                 "       pi_encoder bench <json> [--iterations N]\n"
+                 "       pi_encoder verify <jsonl>\n"
+                 "common: [--compact] [--addr N] [--at-cycle N | --at-ms T]\n");
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) return Usage();
+
+    Options opt;
+    std::vector<const char *> pos;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--compact") == 0) opt.compact = true;
+        else if (std::strcmp(argv[i], "--addr") == 0 && i + 1 < argc) opt.addr = (uint8_t)std::strtol(argv[++i], nullptr, 0);
+        else if (std::strcmp(argv[i], "--interval-us") == 0 && i + 1 < argc) opt.intervalUs = std::atol(argv[++i]);
+        else if (std::strcmp(argv[i], "--count") == 0 && i + 1 < argc) opt.count = std::atol(argv[++i]);
+        else if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) opt.iterations = std::atol(argv[++i]);
+        else if (std::strcmp(argv[i], "--at-cycle") == 0 && i + 1 < argc)
+        {
+            opt.timed = true;
+            opt.when = pi::FrameEncoder::kActivateCycle;
+            opt.at = (uint32_t)std::strtoul(argv[++i], nullptr, 0);
+        }
+        else if (std::strcmp(argv[i], "--at-ms") == 0 && i + 1 < argc)
+        {
+            opt.timed = true;
+            opt.when = pi::FrameEncoder::kActivateTimeMs;
+            opt.at = (uint32_t)std::strtoul(argv[++i], nullptr, 0);
+        }
+        else if (std::strcmp(argv[i], "--baud") == 0 && i + 1 < argc) opt.baud = BaudFlag(std::atol(argv[++i]));
+        else pos.push_back(argv[i]);
+    }
+    if (pos.size() < 2) return Usage();
+
+    std::vector<char> text;
+    if (!ReadFile(pos[1], text))
+    {
+        std::perror(pos[1]);
+        return 1;
+    }
+
+    if (std::strcmp(pos[0], "stream") == 0 && pos.size() >= 3) return CmdStream(text, pos[2], opt);
+    if (std::strcmp(pos[0], "bulk") == 0 && pos.size() >= 3)   return CmdBulk(text, pos[2], opt);
+    if (std::strcmp(pos[0], "bench") == 0)                     return CmdBench(text, opt);
+    if (std::strcmp(pos[0], "verify") == 0)                    return CmdVerify(text, opt);
+    return Usage();
+}
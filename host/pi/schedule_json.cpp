@@ -0,0 +1,222 @@
+#include "schedule_json.hpp"
+
+#include <cmath>
+#include <cstring>
+
+namespace pi
+{
+
+namespace
+{
+
+struct Cursor
+{
+    const char *p;
+    const char *end;
+
+    void SkipWs()
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    }
+
+    bool Take(char c)
+    {
+        SkipWs();
+        if (p < end && *p == c)
+        {
+            p++;
+            return true;
+        }
+        return false;
+    }
+
+    bool Peek(char c)
+    {
+        SkipWs();
+        return p < end && *p == c;
+    }
+};
+
+/* Points key/keyLen into the buffer; escapes are skipped, not decoded. */
+bool ParseString(Cursor &c, const char *&str, size_t &len)
+{
+    if (!c.Take('"')) return false;
+    str = c.p;
+    while (c.p < c.end && *c.p != '"')
+    {
+        if (*c.p == '\\') c.p++;
+        c.p++;
+    }
+    if (c.p >= c.end) return false;
+    len = (size_t)(c.p - str);
+    c.p++;
+    return true;
+}
+
+bool ParseNumber(Cursor &c, double &out)
+{
+    c.SkipWs();
+    const char *p = c.p;
+    bool neg = false;
+    if (p < c.end && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+
+    double v = 0;
+    const char *digits = p;
+    while (p < c.end && *p >= '0' && *p <= '9') v = v * 10 + (*p++ - '0');
+    if (p < c.end && *p == '.')
+    {
+        double scale = 0.1;
+        for (p++; p < c.end && *p >= '0' && *p <= '9'; p++, scale *= 0.1) v += (*p - '0') * scale;
+    }
+    if (p == digits) return false;
+    if (p < c.end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        bool eneg = false;
+        if (p < c.end && (*p == '-' || *p == '+')) eneg = (*p++ == '-');
+        int e = 0;
+        while (p < c.end && *p >= '0' && *p <= '9') e = e * 10 + (*p++ - '0');
+        v *= std::pow(10.0, eneg ? -e : e);
+    }
+
+    c.p = p;
+    out = neg ? -v : v;
+    return true;
+}
+
+bool ParseByte(Cursor &c, uint8_t &out)
+{
+    double v;
+    if (!ParseNumber(c, v) || v < 0 || v > 255) return false;
+    out = (uint8_t)v;
+    return true;
+}
+
+bool ParseSecondsMs(Cursor &c, uint32_t &out, bool &seen)
+{
+    double sec;
+    if (!ParseNumber(c, sec) || sec < 0 || sec > 4e6) return false;
+    out = (uint32_t)std::llround(sec * 1000.0);
+    seen = true;
+    return true;
+}
+
+bool SkipValue(Cursor &c, int depth = 0)
+{
+    if (depth > 16) return false;
+    c.SkipWs();
+    if (c.p >= c.end) return false;
+
+    if (*c.p == '"')
+    {
+        const char *s;
+        size_t n;
+        return ParseString(c, s, n);
+    }
+    if (*c.p == '{' || *c.p == '[')
+    {
+        char close = (*c.p == '{') ? '}' : ']';
+        bool object = (*c.p == '{');
+        c.p++;
+        if (c.Take(close)) return true;
+        do
+        {
+            if (object)
+            {
+                const char *s;
+                size_t n;
+                if (!ParseString(c, s, n) || !c.Take(':')) return false;
+            }
+            if (!SkipValue(c, depth + 1)) return false;
+        } while (c.Take(','));
+        return c.Take(close);
+    }
+
+    while (c.p < c.end && *c.p != ',' && *c.p != '}' && *c.p != ']' && *c.p != ' ' && *c.p != '\n' && *c.p != '\r' && *c.p != '\t') c.p++;
+    return true;
+}
+
+bool ParseStageTimes(Cursor &c, Schedule &out)
+{
+    if (!c.Take('[')) return false;
+    out.timeCount = 0;
+    if (c.Take(']')) return true;
+    do
+    {
+        double sec;
+        if (out.timeCount >= kMaxStages || !ParseNumber(c, sec) || sec < 0) return false;
+        out.stageTimesMs[out.timeCount++] = (uint32_t)std::llround(sec * 1000.0);
+    } while (c.Take(','));
+    return c.Take(']');
+}
+
+bool ParseStages(Cursor &c, Schedule &out)
+{
+    if (!c.Take('[')) return false;
+    out.patternCount = 0;
+    if (c.Take(']')) return true;
+    do
+    {
+        if (out.patternCount >= kMaxStages || !c.Take('[')) return false;
+        uint32_t bits = 0;
+        int n = 0;
+        if (!c.Peek(']'))
+        {
+            do
+            {
+                double v;
+                if (n >= 32 || !ParseNumber(c, v)) return false;
+                bits = (bits << 1) | (v != 0 ? 1u : 0u);
+                n++;
+            } while (c.Take(','));
+        }
+        if (!c.Take(']')) return false;
+        out.patterns[out.patternCount++] = bits;
+    } while (c.Take(','));
+    return c.Take(']');
+}
+
+bool KeyIs(const char *key, size_t len, const char *name)
+{
+    return std::strlen(name) == len && std::memcmp(key, name, len) == 0;
+}
+
+} // namespace
+
+const char *ParseSchedule(const char *begin, const char *end, Schedule &out)
+{
+    Cursor c{begin, end};
+    out = Schedule{};
+
+    if (!c.Take('{')) return nullptr;
+    if (!c.Take('}'))
+    {
+        do
+        {
+            const char *key;
+            size_t len;
+            if (!ParseString(c, key, len) || !c.Take(':')) return nullptr;
+
+            bool ok;
+            if (KeyIs(key, len, "StageNum"))        ok = ParseByte(c, out.stageNum);
+            else if (KeyIs(key, len, "MaxLight"))   ok = ParseByte(c, out.maxLight);
+            else if (KeyIs(key, len, "green_Ext"))  ok = ParseByte(c, out.greenExt);
+            else if (KeyIs(key, len, "Interrupt"))  ok = ParseByte(c, out.interrupt);
+            else if (KeyIs(key, len, "StageTimes")) ok = ParseStageTimes(c, out);
+            else if (KeyIs(key, len, "Stages"))     ok = ParseStages(c, out);
+            else if (KeyIs(key, len, "offset_tol"))    ok = ParseSecondsMs(c, out.offsetTolMs, out.hasOffsets);
+            else if (KeyIs(key, len, "offset_maxDed")) ok = ParseSecondsMs(c, out.offsetMaxDedMs, out.hasOffsets);
+            else if (KeyIs(key, len, "offset_maxExt")) ok = ParseSecondsMs(c, out.offsetMaxExtMs, out.hasOffsets);
+            else if (KeyIs(key, len, "offset_phase"))  ok = ParseSecondsMs(c, out.offsetPhaseMs, out.hasOffsets);
+            else                                    ok = SkipValue(c);
+            if (!ok) return nullptr;
+        } while (c.Take(','));
+        if (!c.Take('}')) return nullptr;
+    }
+
+    if (out.stageNum == 0 || out.stageNum > kMaxStages) return nullptr;
+    if (out.timeCount < out.stageNum || out.patternCount < out.stageNum) return nullptr;
+    return c.p;
+}
+
+} // namespace pi
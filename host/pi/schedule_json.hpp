@@ -0,0 +1,42 @@
+#ifndef PI_SCHEDULE_JSON_HPP
+#define PI_SCHEDULE_JSON_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pi
+{
+
+constexpr int kMaxStages = 32;  // PACKET_MAX_STAGES
+
+/* One intersection schedule as described by the controller JSON. Fixed
+ * arrays only, so parsing and encoding never allocate. */
+struct Schedule
+{
+    uint8_t  stageNum = 0;
+    uint8_t  maxLight = 0;
+    uint8_t  greenExt = 0;
+    uint8_t  interrupt = 0;
+    uint8_t  timeCount = 0;
+    uint8_t  patternCount = 0;
+    bool     hasOffsets = false;   // any offset_* key present
+    uint32_t offsetTolMs = 0;
+    uint32_t offsetMaxDedMs = 0;
+    uint32_t offsetMaxExtMs = 0;
+    uint32_t offsetPhaseMs = 0;
+    uint32_t stageTimesMs[kMaxStages] = {};
+    uint32_t patterns[kMaxStages] = {};
+};
+
+/*
+ * Parses one JSON object (the `json file` layout) from [begin, end). Keys
+ * the encoder does not need are skipped. StageTimes and the offset_* limits
+ * are seconds and are rounded to milliseconds; element k of a Stages row becomes bit
+ * (rowLength - 1 - k) of the pattern. Returns a pointer just past the
+ * object, or nullptr if the text is malformed or does not fit Schedule.
+ */
+const char *ParseSchedule(const char *begin, const char *end, Schedule &out);
+
+} // namespace pi
+
+#endif
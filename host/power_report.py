@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Wake-ups per signal cycle and an average current estimate from the sim.
+
+    FREERTOS_KERNEL=... sim/build.sh
+    ./power_report.py --run-ma R --sleep-ma S            # sample json file
+    ./power_report.py --run-ma R --sleep-ma S --stage-ms 500 --cycles 20
+
+Starts sim/traffic_sim, sends one schedule and reads the stats counters
+(stats.h) once the first cycle has started and again --cycles cycles
+later. wakeups counts tasks switched in after the idle task; on the board
+sleeps also counts interrupts that end a sleep without waking a task, and
+stays 0 in the simulation. The estimate is
+
+    I = run_ma * busy + sleep_ma * (1 - busy),   busy = 1 - idle_ms / uptime_ms
+
+where run_ma and sleep_ma are the board's Run and Sleep mode currents at
+its clock setting, measured or taken from the datasheet; they are not
+guessed here.
+"""
+import argparse
+import json
+import os
+import sys
+import time
+
+from bench_latency import start_sim
+from feed_packets import frame, legacy_payload
+from stats_query import FIELDS, query
+
+
+def stats(fd, addr, timeout):
+    values = query(fd, addr, timeout)
+    if values is None:
+        raise RuntimeError("no stats reply")
+    return dict(zip(FIELDS, values))
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--sim", default=os.path.join(here, "sim", "traffic_sim"))
+    ap.add_argument("--json", default=os.path.join(here, "..", "json file"))
+    ap.add_argument("--addr", type=lambda v: int(v, 0), default=0x01)
+    ap.add_argument("--stage-ms", type=int, default=0, help="0 keeps the JSON stage times")
+    ap.add_argument("--cycles", type=int, default=2)
+    ap.add_argument("--tick-hz", type=int, default=1000, help="configTICK_RATE_HZ")
+    ap.add_argument("--run-ma", type=float, required=True, help="Run mode current")
+    ap.add_argument("--sleep-ma", type=float, required=True, help="Sleep mode current")
+    args = ap.parse_args()
+
+    with open(args.json) as f:
+        cfg = json.load(f)
+    if args.stage_ms:
+        cfg["StageTimes"] = [args.stage_ms / 1000.0] * len(cfg["StageTimes"])
+    cycle_s = sum(cfg["StageTimes"][:cfg["StageNum"]])
+
+    sim, tty = start_sim(args.sim)
+    fd = os.open(tty, os.O_RDWR | os.O_NOCTTY)
+    try:
+        os.write(fd, frame(legacy_payload(cfg), args.addr))
+        while True:
+            first = stats(fd, args.addr, 2.0)
+            if first["cycle_count"] >= 1:
+                break
+            time.sleep(0.2)
+        while True:
+            time.sleep(min(cycle_s / 4.0, 10.0))
+            last = stats(fd, args.addr, 2.0)
+            if last["cycle_count"] >= first["cycle_count"] + args.cycles:
+                break
+    finally:
+        os.close(fd)
+        sim.kill()
+        sim.wait()
+
+    d = {k: last[k] - first[k] for k in ("cycle_count", "uptime_ms", "idle_ms", "wakeups", "sleeps")}
+    cycles = float(d["cycle_count"])
+    busy = 1.0 - d["idle_ms"] / float(d["uptime_ms"])
+    print("%d stages, %.1f s cycle, %d cycles measured over %.1f s"
+          % (cfg["StageNum"], cycle_s, d["cycle_count"], d["uptime_ms"] / 1000.0))
+    print("  wake-ups per cycle     %10.1f   (ticks per cycle %d)"
+          % (d["wakeups"] / cycles, round(d["uptime_ms"] * args.tick_hz / 1000.0 / cycles)))
+    print("  sleeps per cycle       %10.1f" % (d["sleeps"] / cycles))
+    print("  busy                   %10.4f %%" % (100.0 * busy))
+    print("  stage late max         %10d ms" % last["stage_late_max_ms"])
+    print("  estimated current      %10.3f mA" % (args.run_ma * busy + args.sleep_ma * (1.0 - busy)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,57 @@
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+/* FreeRTOS configuration for the Linux (POSIX port) host simulation. */
+
+#include <limits.h>
+
+#define configUSE_PREEMPTION                    1
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION 0
+#define configUSE_IDLE_HOOK                     0
+#define configUSE_TICK_HOOK                     1
+#define configTICK_RATE_HZ                      1000
+#define configMAX_PRIORITIES                    7
+#define configMINIMAL_STACK_SIZE                ((unsigned short)PTHREAD_STACK_MIN)
+#define configTOTAL_HEAP_SIZE                   ((size_t)(256 * 1024))
+#define configMAX_TASK_NAME_LEN                 16
+#define configUSE_TRACE_FACILITY                1
+#define configTICK_TYPE_WIDTH_IN_BITS           TICK_TYPE_WIDTH_32_BITS
+#define configIDLE_SHOULD_YIELD                 1
+#define configUSE_MUTEXES                       1
+#define configUSE_RECURSIVE_MUTEXES             0
+#define configUSE_COUNTING_SEMAPHORES           1
+#define configQUEUE_REGISTRY_SIZE               0
+#define configUSE_TASK_NOTIFICATIONS            1
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES   1
+#define configSUPPORT_DYNAMIC_ALLOCATION        1
+#define configSUPPORT_STATIC_ALLOCATION         1
+#define configCHECK_FOR_STACK_OVERFLOW          0
+#define configUSE_MALLOC_FAILED_HOOK            0
+#define configGENERATE_RUN_TIME_STATS           0
+
+#define configUSE_TIMERS                        1
+#define configTIMER_TASK_PRIORITY               (configMAX_PRIORITIES - 1)
+#define configTIMER_QUEUE_LENGTH                10
+#define configTIMER_TASK_STACK_DEPTH            configMINIMAL_STACK_SIZE
+
+#define INCLUDE_vTaskPrioritySet                1
+#define INCLUDE_uxTaskPriorityGet               1
+#define INCLUDE_vTaskDelete                     1
+#define INCLUDE_vTaskSuspend                    1
+#define INCLUDE_xTaskDelayUntil                 1
+#define INCLUDE_vTaskDelay                      1
+#define INCLUDE_xTaskGetSchedulerState          1
+#define INCLUDE_xTaskGetCurrentTaskHandle       1
+#define INCLUDE_uxTaskGetStackHighWaterMark     1
+#define INCLUDE_xTaskAbortDelay                 1
+#define INCLUDE_xTaskGetIdleTaskHandle          1
+
+/* The POSIX port has no tickless idle; wake-ups and idle time are still
+ * counted from task switches (power.h). */
+extern void Power_TaskSwitchedIn(void);
+#define traceTASK_SWITCHED_IN() Power_TaskSwitchedIn()
+
+extern void vAssertCalled(const char *file, unsigned long line);
+#define configASSERT(x) if ((x) == 0) vAssertCalled(__FILE__, __LINE__)
+
+#endif
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Builds the Linux host simulation: the firmware sources compiled unchanged
+# against the FreeRTOS POSIX port and the HAL stand-in in this directory.
+#
+#   FREERTOS_KERNEL=/path/to/FreeRTOS-Kernel ./build.sh
+#   ./traffic_sim                      # prints "SIM: USART6 on /dev/pts/N"
+#   ../feed_packets.py /dev/pts/N --interval-ms 5
+set -e
+
+K=${FREERTOS_KERNEL:?set FREERTOS_KERNEL to a FreeRTOS-Kernel checkout}
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$HERE/../..
+PORT=$K/portable/ThirdParty/GCC/Posix
+
+${CC:-cc} -std=gnu11 -O2 -g -pthread -DHOST_SIM ${CFLAGS} \
+    -I"$HERE" -I"$ROOT" -I"$K/include" -I"$PORT" -I"$PORT/utils" \
+    "$ROOT/main.c" \
+    "$ROOT/freertos.c" \
+    "$ROOT/packet_codec.c" \
+    "$ROOT/crc32.c" \
+    "$ROOT/schedule.c" \
+    "$ROOT/conflict.c" \
+    "$ROOT/schedule_store.c" \
+    "$ROOT/flash_ram.c" \
+    "$ROOT/frame_pool.c" \
+    "$ROOT/power.c" \
+    "$ROOT/log_ring.c" \
+    "$ROOT/log_format.c" \
+    "$ROOT/probe.c" \
+    "$ROOT/clock_sync.c" \
+    "$HERE/hal_sim.c" \
+    "$K/tasks.c" "$K/queue.c" "$K/list.c" "$K/timers.c" "$K/stream_buffer.c" "$K/event_groups.c" \
+    "$K/portable/MemMang/heap_3.c" "$PORT/port.c" "$PORT/utils/wait_for_event.c" \
+    -o "$HERE/traffic_sim"
@@ -0,0 +1,47 @@
+#ifndef SIM_CMSIS_OS_H
+#define SIM_CMSIS_OS_H
+
+/* The slice of CMSIS-RTOS v2 used by main.c, mapped onto FreeRTOS. */
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+typedef void *osThreadId_t;
+typedef void (*osThreadFunc_t)(void *argument);
+
+typedef enum
+{
+    osPriorityLow         = 8,
+    osPriorityBelowNormal = 16,
+    osPriorityNormal      = 24,
+    osPriorityAboveNormal = 32,
+    osPriorityHigh        = 40,
+    osPriorityRealtime    = 48,
+    osPriorityISR         = 56
+} osPriority_t;
+
+typedef struct
+{
+    const char   *name;
+    uint32_t      attr_bits;
+    void         *cb_mem;
+    uint32_t      cb_size;
+    void         *stack_mem;
+    uint32_t      stack_size;
+    osPriority_t  priority;
+} osThreadAttr_t;
+
+typedef enum
+{
+    osOK    = 0,
+    osError = -1
+} osStatus_t;
+
+osStatus_t osKernelInitialize(void);
+osStatus_t osKernelStart(void);
+osThreadId_t osThreadNew(osThreadFunc_t func, void *argument, const osThreadAttr_t *attr);
+uint32_t osThreadGetStackSpace(osThreadId_t thread_id);
+
+#endif
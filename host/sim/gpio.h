@@ -0,0 +1,8 @@
+#ifndef SIM_GPIO_H
+#define SIM_GPIO_H
+
+#include "main.h"
+
+void MX_GPIO_Init(void);
+
+#endif
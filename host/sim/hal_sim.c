@@ -0,0 +1,428 @@
+/*
+ * HAL stand-in for the Linux host simulation.
+ *
+ *   USART6  -> a pseudo-terminal; its slave path is printed at start-up.
+ *              Received bytes are moved into the firmware's DMA ring from
+ *              the FreeRTOS tick hook (interrupt context in the POSIX port),
+ *              which then raises the IDLE-line RX event.
+ *   GPIO    -> every output change is appended to a CSV trace
+ *              (SIM_GPIO_TRACE, default gpio_trace.csv): t_us,port,odr.
+ *   EXTI    -> vehicle detector edges are read from SIM_DETECTORS (a file
+ *              or a FIFO), one per line: "<t_ms> <detector>" fires at that
+ *              many ms after start-up, a bare "<detector>" fires at once.
+ *              Lines are taken in order from the tick hook and delivered to
+ *              HAL_GPIO_EXTI_Callback for EXTI line <detector>.
+ *   Flash   -> sectors 2 and 3 are SIM_FLASH (default sim_flash.bin),
+ *              mapped at 0x08008000. Programming can only clear bits, as
+ *              on the chip.
+ *
+ * Build with build.sh in this directory.
+ */
+#define _GNU_SOURCE
+
+#include "main.h"
+#include "usart.h"
+#include "gpio.h"
+#include "cmsis_os.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+GPIO_TypeDef SimGPIO[SIM_GPIO_PORTS];
+USART_TypeDef SimUSART6 = { -1 };
+uint32_t SystemCoreClock = 1000000000u;
+
+UART_HandleTypeDef huart6;
+static DMA_HandleTypeDef simUart6RxDma;
+static DMA_HandleTypeDef simUart6TxDma;
+
+static FILE *gpioTrace = NULL;
+static uint64_t simStartUs = 0;
+
+static uint8_t *rxDmaBuf = NULL;
+static uint16_t rxDmaSize = 0;
+static uint16_t rxDmaPos = 0;
+static volatile uint8_t txPending = 0;
+
+#define SIM_FLASH_BASE   0x08008000u
+#define SIM_FLASH_SECTOR 0x4000u
+static uint8_t *simFlash = NULL;
+
+static int detectorFd = -1;
+static char detectorLine[64];
+static size_t detectorLineLen = 0;
+static int detectorNext = -1;
+static uint32_t detectorNextMs = 0;
+
+static uint64_t Sim_MonotonicUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static void Sim_TraceGpio(const GPIO_TypeDef *port)
+{
+    if (gpioTrace == NULL) return;
+    fprintf(gpioTrace, "%llu,%c,0x%04x\n",
+            (unsigned long long)(Sim_MonotonicUs() - simStartUs),
+            (char)('A' + (port - SimGPIO)), (unsigned)(port->ODR & 0xFFFFu));
+    fflush(gpioTrace);
+}
+
+void SimWriteReg(volatile uint32_t *reg, uint32_t val)
+{
+    for (int p = 0; p < SIM_GPIO_PORTS; p++)
+    {
+        GPIO_TypeDef *port = &SimGPIO[p];
+        if (reg == &port->BSRR)
+        {
+            port->ODR = (port->ODR | (val & 0xFFFFu)) & ~(val >> 16);
+            Sim_TraceGpio(port);
+            return;
+        }
+    }
+    *reg = val;
+}
+
+void vAssertCalled(const char *file, unsigned long line)
+{
+    fprintf(stderr, "SIM: assert %s:%lu\n", file, line);
+    abort();
+}
+
+/* ---- Flash --------------------------------------------------------------- */
+
+static void Sim_FlashMap(void)
+{
+    const char *path = getenv("SIM_FLASH");
+    int fd = open(path != NULL ? path : "sim_flash.bin", O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        perror("SIM: SIM_FLASH");
+        exit(1);
+    }
+
+    /* A new file reads as erased flash. */
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size < (off_t)(2 * SIM_FLASH_SECTOR))
+    {
+        static uint8_t erased[4096];
+        memset(erased, 0xFF, sizeof(erased));
+        for (off_t off = size; off < (off_t)(2 * SIM_FLASH_SECTOR); off += (off_t)sizeof(erased))
+        {
+            if (pwrite(fd, erased, sizeof(erased), off) != (ssize_t)sizeof(erased)) break;
+        }
+    }
+
+    void *p = mmap((void *)(uintptr_t)SIM_FLASH_BASE, 2 * SIM_FLASH_SECTOR, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+    close(fd);
+    if (p != (void *)(uintptr_t)SIM_FLASH_BASE)
+    {
+        perror("SIM: mapping flash at 0x08008000");
+        exit(1);
+    }
+    simFlash = p;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void)
+{
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+    if (TypeProgram != FLASH_TYPEPROGRAM_WORD || (Address & 3u) != 0 ||
+        Address < SIM_FLASH_BASE || Address - SIM_FLASH_BASE > 2 * SIM_FLASH_SECTOR - 4u)
+        return HAL_ERROR;
+
+    uint32_t *word = (uint32_t *)&simFlash[Address - SIM_FLASH_BASE];
+    uint32_t val = (uint32_t)Data;
+    if ((*word & val) != val) return HAL_ERROR;
+    *word = val;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *SectorError)
+{
+    *SectorError = 0xFFFFFFFFu;
+    for (uint32_t s = pEraseInit->Sector; s < pEraseInit->Sector + pEraseInit->NbSectors; s++)
+    {
+        if (s != FLASH_SECTOR_2 && s != FLASH_SECTOR_3)
+        {
+            *SectorError = s;
+            return HAL_ERROR;
+        }
+        memset(&simFlash[(s - FLASH_SECTOR_2) * SIM_FLASH_SECTOR], 0xFF, SIM_FLASH_SECTOR);
+    }
+    return HAL_OK;
+}
+
+/* ---- HAL core ------------------------------------------------------------ */
+
+void HAL_Init(void)
+{
+    simStartUs = Sim_MonotonicUs();
+
+    const char *path = getenv("SIM_GPIO_TRACE");
+    gpioTrace = fopen(path != NULL ? path : "gpio_trace.csv", "w");
+    if (gpioTrace != NULL) fputs("t_us,port,odr\n", gpioTrace);
+
+    path = getenv("SIM_DETECTORS");
+    if (path != NULL)
+    {
+        detectorFd = open(path, O_RDONLY | O_NONBLOCK);
+        if (detectorFd < 0) perror("SIM: SIM_DETECTORS");
+    }
+
+    Sim_FlashMap();
+}
+
+uint32_t HAL_GetTick(void)
+{
+    return (uint32_t)((Sim_MonotonicUs() - simStartUs) / 1000u);
+}
+
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef *RCC_OscInitStruct)
+{
+    (void)RCC_OscInitStruct;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef *RCC_ClkInitStruct, uint32_t FLatency)
+{
+    (void)RCC_ClkInitStruct;
+    (void)FLatency;
+    return HAL_OK;
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+    (void)IRQn;
+    (void)PreemptPriority;
+    (void)SubPriority;
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+    (void)IRQn;
+}
+
+/* ---- GPIO ---------------------------------------------------------------- */
+
+void MX_GPIO_Init(void)
+{
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init)
+{
+    (void)GPIOx;
+    (void)GPIO_Init;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+    if (PinState == GPIO_PIN_SET)
+        GPIOx->ODR |= GPIO_Pin;
+    else
+        GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+    Sim_TraceGpio(GPIOx);
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+    return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+/* Fires every scripted detector edge that is due, reading more of the
+ * script as needed; a FIFO with no writer just reads as empty. */
+static void Sim_PollDetectors(void)
+{
+    if (detectorFd < 0) return;
+
+    uint32_t now = HAL_GetTick();
+    for (;;)
+    {
+        if (detectorNext >= 0)
+        {
+            if ((int32_t)(now - detectorNextMs) < 0) return;
+            HAL_GPIO_EXTI_Callback((uint16_t)(GPIO_PIN_0 << detectorNext));
+            detectorNext = -1;
+        }
+
+        char *nl = memchr(detectorLine, '\n', detectorLineLen);
+        if (nl == NULL)
+        {
+            if (detectorLineLen == sizeof(detectorLine)) detectorLineLen = 0;
+            ssize_t n = read(detectorFd, &detectorLine[detectorLineLen], sizeof(detectorLine) - detectorLineLen);
+            if (n <= 0) return;
+            detectorLineLen += (size_t)n;
+            continue;
+        }
+
+        *nl = '\0';
+        unsigned long t;
+        int d;
+        if (sscanf(detectorLine, "%lu %d", &t, &d) == 2)
+            detectorNextMs = (uint32_t)t;
+        else if (sscanf(detectorLine, "%d", &d) == 1)
+            detectorNextMs = now;
+        else
+            d = -1;
+        if (d >= 0 && d < 16) detectorNext = d;
+
+        size_t used = (size_t)(nl + 1 - detectorLine);
+        memmove(detectorLine, nl + 1, detectorLineLen - used);
+        detectorLineLen -= used;
+    }
+}
+
+/* ---- UART ---------------------------------------------------------------- */
+
+void MX_USART6_UART_Init(void)
+{
+    huart6.Instance = USART6;
+    huart6.hdmarx = &simUart6RxDma;
+    huart6.hdmatx = &simUart6TxDma;
+
+    int fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0)
+    {
+        perror("SIM: posix_openpt");
+        exit(1);
+    }
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+
+    SimUSART6.fd = fd;
+    fprintf(stderr, "SIM: USART6 on %s\n", ptsname(fd));
+}
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma)
+{
+    (void)hdma;
+    return HAL_OK;
+}
+
+static HAL_StatusTypeDef Sim_UartWrite(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size)
+{
+    while (Size > 0)
+    {
+        ssize_t n = write(huart->Instance->fd, pData, Size);
+        if (n < 0)
+        {
+            /* Nobody reading the pty: drop, like a disconnected cable. */
+            if (errno == EAGAIN || errno == EIO) break;
+            return HAL_ERROR;
+        }
+        pData += n;
+        Size -= (uint16_t)n;
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    (void)Timeout;
+    return Sim_UartWrite(huart, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_IT(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size)
+{
+    return HAL_UART_Transmit_DMA(huart, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size)
+{
+    if (txPending) return HAL_BUSY;
+
+    HAL_StatusTypeDef st = Sim_UartWrite(huart, pData, Size);
+    if (st == HAL_OK) txPending = 1;
+    return st;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size)
+{
+    (void)huart;
+    rxDmaBuf = pData;
+    rxDmaSize = Size;
+    rxDmaPos = 0;
+    return HAL_OK;
+}
+
+/* Runs in the POSIX port's tick interrupt: fires due detector edges,
+ * completes the pending TX "DMA" and delivers whatever arrived on the pty
+ * as one IDLE-line RX event. */
+void vApplicationTickHook(void)
+{
+    Sim_PollDetectors();
+
+    if (txPending)
+    {
+        txPending = 0;
+        HAL_UART_TxCpltCallback(&huart6);
+    }
+
+    if (rxDmaBuf == NULL || SimUSART6.fd < 0) return;
+
+    ssize_t n = read(SimUSART6.fd, &rxDmaBuf[rxDmaPos], (size_t)(rxDmaSize - rxDmaPos));
+    if (n > 0)
+    {
+        rxDmaPos = (uint16_t)(rxDmaPos + n);
+        uint16_t size = rxDmaPos;
+        if (rxDmaPos >= rxDmaSize) rxDmaPos = 0;
+        HAL_UARTEx_RxEventCallback(&huart6, size);
+    }
+}
+
+/* ---- CMSIS-RTOS v2 ------------------------------------------------------- */
+
+osStatus_t osKernelInitialize(void)
+{
+    return osOK;
+}
+
+osStatus_t osKernelStart(void)
+{
+    vTaskStartScheduler();
+    return osError;
+}
+
+/* Host threads need more stack than the firmware's static stacks hold, so
+ * cb_mem and stack_mem are ignored and every task comes from the heap. */
+osThreadId_t osThreadNew(osThreadFunc_t func, void *argument, const osThreadAttr_t *attr)
+{
+    UBaseType_t prio = (UBaseType_t)(attr->priority * (configMAX_PRIORITIES - 1) / osPriorityISR);
+    uint32_t depth = attr->stack_size / sizeof(StackType_t);
+    if (depth < configMINIMAL_STACK_SIZE) depth = configMINIMAL_STACK_SIZE;
+
+    TaskHandle_t handle = NULL;
+    if (xTaskCreate(func, attr->name, depth, argument, prio, &handle) != pdPASS) return NULL;
+    return (osThreadId_t)handle;
+}
+
+uint32_t osThreadGetStackSpace(osThreadId_t thread_id)
+{
+    return (uint32_t)(uxTaskGetStackHighWaterMark((TaskHandle_t)thread_id) * sizeof(StackType_t));
+}
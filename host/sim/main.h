@@ -0,0 +1,255 @@
+#ifndef SIM_MAIN_H
+#define SIM_MAIN_H
+
+/*
+ * HAL stand-in for the Linux host simulation. It declares just the subset
+ * of the STM32F4 HAL/CMSIS surface that the firmware sources use, so
+ * main.c and freertos.c build unchanged against the FreeRTOS POSIX port.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef HOST_SIM
+#define HOST_SIM 1
+#endif
+
+typedef enum
+{
+    HAL_OK = 0,
+    HAL_ERROR,
+    HAL_BUSY,
+    HAL_TIMEOUT
+} HAL_StatusTypeDef;
+
+/* ---- Core / NVIC ------------------------------------------------------- */
+
+typedef enum
+{
+    EXTI0_IRQn        = 6,
+    EXTI1_IRQn        = 7,
+    EXTI2_IRQn        = 8,
+    EXTI3_IRQn        = 9,
+    DMA2_Stream1_IRQn = 57,
+    DMA2_Stream6_IRQn = 69,
+    USART6_IRQn       = 71
+} IRQn_Type;
+
+extern uint32_t SystemCoreClock;
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority);
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn);
+
+#define __disable_irq() do { } while (0)
+#define __enable_irq()  do { } while (0)
+
+/* Register stores go through the simulator so GPIO writes can be traced. */
+void SimWriteReg(volatile uint32_t *reg, uint32_t val);
+#define WRITE_REG(REG, VAL) SimWriteReg(&(REG), (uint32_t)(VAL))
+#define READ_REG(REG)       (REG)
+
+void HAL_Init(void);
+uint32_t HAL_GetTick(void);
+void Error_Handler(void);
+
+/* ---- RCC / PWR (accepted and ignored) ----------------------------------- */
+
+typedef struct
+{
+    uint32_t PLLState;
+    uint32_t PLLSource;
+    uint32_t PLLM;
+    uint32_t PLLN;
+    uint32_t PLLP;
+    uint32_t PLLQ;
+} RCC_PLLInitTypeDef;
+
+typedef struct
+{
+    uint32_t OscillatorType;
+    uint32_t HSEState;
+    uint32_t HSIState;
+    RCC_PLLInitTypeDef PLL;
+} RCC_OscInitTypeDef;
+
+typedef struct
+{
+    uint32_t ClockType;
+    uint32_t SYSCLKSource;
+    uint32_t AHBCLKDivider;
+    uint32_t APB1CLKDivider;
+    uint32_t APB2CLKDivider;
+} RCC_ClkInitTypeDef;
+
+#define RCC_OSCILLATORTYPE_HSE   0x1u
+#define RCC_HSE_ON               0x1u
+#define RCC_HSI_ON               0x1u
+#define RCC_PLL_ON               0x2u
+#define RCC_PLLSOURCE_HSE        0x1u
+#define RCC_PLLP_DIV2            0x2u
+#define RCC_CLOCKTYPE_SYSCLK     0x1u
+#define RCC_CLOCKTYPE_HCLK       0x2u
+#define RCC_CLOCKTYPE_PCLK1      0x4u
+#define RCC_CLOCKTYPE_PCLK2      0x8u
+#define RCC_SYSCLKSOURCE_PLLCLK  0x2u
+#define RCC_SYSCLK_DIV1          0x0u
+#define RCC_HCLK_DIV2            0x4u
+#define RCC_HCLK_DIV4            0x5u
+#define FLASH_LATENCY_5          0x5u
+#define PWR_REGULATOR_VOLTAGE_SCALE1 0x1u
+
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef *RCC_OscInitStruct);
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef *RCC_ClkInitStruct, uint32_t FLatency);
+
+#define __HAL_RCC_PWR_CLK_ENABLE()           do { } while (0)
+#define __HAL_PWR_VOLTAGESCALING_CONFIG(x)   do { (void)(x); } while (0)
+#define __HAL_RCC_GPIOA_CLK_ENABLE()         do { } while (0)
+#define __HAL_RCC_GPIOB_CLK_ENABLE()         do { } while (0)
+#define __HAL_RCC_GPIOC_CLK_ENABLE()         do { } while (0)
+#define __HAL_RCC_GPIOD_CLK_ENABLE()         do { } while (0)
+#define __HAL_RCC_GPIOE_CLK_ENABLE()         do { } while (0)
+#define __HAL_RCC_GPIOF_CLK_ENABLE()         do { } while (0)
+#define __HAL_RCC_GPIOG_CLK_ENABLE()         do { } while (0)
+
+/* ---- Flash ---------------------------------------------------------------- */
+
+/* Sectors 2 and 3 are a file (SIM_FLASH, default sim_flash.bin) mapped
+ * at their real addresses, so a stored schedule survives a restart. */
+#define FLASH_SECTOR_2           2u
+#define FLASH_SECTOR_3           3u
+#define FLASH_TYPEERASE_SECTORS  0x0u
+#define FLASH_TYPEPROGRAM_WORD   0x2u
+#define FLASH_VOLTAGE_RANGE_3    0x2u
+
+typedef struct
+{
+    uint32_t TypeErase;
+    uint32_t Banks;
+    uint32_t Sector;
+    uint32_t NbSectors;
+    uint32_t VoltageRange;
+} FLASH_EraseInitTypeDef;
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *SectorError);
+
+/* ---- GPIO ---------------------------------------------------------------- */
+
+typedef struct
+{
+    volatile uint32_t MODER;
+    volatile uint32_t OTYPER;
+    volatile uint32_t OSPEEDR;
+    volatile uint32_t PUPDR;
+    volatile uint32_t IDR;
+    volatile uint32_t ODR;
+    volatile uint32_t BSRR;
+} GPIO_TypeDef;
+
+#define SIM_GPIO_PORTS 7
+extern GPIO_TypeDef SimGPIO[SIM_GPIO_PORTS];
+
+#define GPIOA (&SimGPIO[0])
+#define GPIOB (&SimGPIO[1])
+#define GPIOC (&SimGPIO[2])
+#define GPIOD (&SimGPIO[3])
+#define GPIOE (&SimGPIO[4])
+#define GPIOF (&SimGPIO[5])
+#define GPIOG (&SimGPIO[6])
+
+typedef enum
+{
+    GPIO_PIN_RESET = 0,
+    GPIO_PIN_SET
+} GPIO_PinState;
+
+typedef struct
+{
+    uint32_t Pin;
+    uint32_t Mode;
+    uint32_t Pull;
+    uint32_t Speed;
+    uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+#define GPIO_PIN_0   ((uint16_t)0x0001)
+#define GPIO_PIN_1   ((uint16_t)0x0002)
+#define GPIO_PIN_2   ((uint16_t)0x0004)
+#define GPIO_PIN_3   ((uint16_t)0x0008)
+#define GPIO_PIN_4   ((uint16_t)0x0010)
+#define GPIO_PIN_5   ((uint16_t)0x0020)
+#define GPIO_PIN_6   ((uint16_t)0x0040)
+#define GPIO_PIN_7   ((uint16_t)0x0080)
+#define GPIO_PIN_8   ((uint16_t)0x0100)
+#define GPIO_PIN_9   ((uint16_t)0x0200)
+#define GPIO_PIN_10  ((uint16_t)0x0400)
+#define GPIO_PIN_11  ((uint16_t)0x0800)
+#define GPIO_PIN_12  ((uint16_t)0x1000)
+#define GPIO_PIN_13  ((uint16_t)0x2000)
+#define GPIO_PIN_14  ((uint16_t)0x4000)
+#define GPIO_PIN_15  ((uint16_t)0x8000)
+
+#define GPIO_MODE_INPUT        0x0u
+#define GPIO_MODE_OUTPUT_PP    0x1u
+#define GPIO_MODE_IT_RISING    0x10110000u
+#define GPIO_MODE_IT_FALLING   0x10210000u
+#define GPIO_NOPULL            0x0u
+#define GPIO_PULLUP            0x1u
+#define GPIO_PULLDOWN          0x2u
+#define GPIO_SPEED_FREQ_LOW    0x0u
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init);
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+
+/* Implemented by the firmware; hal_sim.c calls it for scripted detector
+ * edges (EXTI line d is GPIO_PIN_0 << d). */
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin);
+
+/* ---- DMA / UART -------------------------------------------------------- */
+
+#define DMA_NORMAL   0x000u
+#define DMA_CIRCULAR 0x100u
+
+typedef struct
+{
+    uint32_t Mode;
+} DMA_InitTypeDef;
+
+typedef struct
+{
+    DMA_InitTypeDef Init;
+} DMA_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma);
+
+typedef struct
+{
+    int fd;
+} USART_TypeDef;
+
+extern USART_TypeDef SimUSART6;
+#define USART6 (&SimUSART6)
+
+typedef struct
+{
+    USART_TypeDef     *Instance;
+    DMA_HandleTypeDef *hdmarx;
+    DMA_HandleTypeDef *hdmatx;
+} UART_HandleTypeDef;
+
+#define HAL_MAX_DELAY 0xFFFFFFFFu
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_UART_Transmit_IT(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size);
+
+/* Implemented by the firmware. */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size);
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef SIM_USART_H
+#define SIM_USART_H
+
+#include "main.h"
+
+extern UART_HandleTypeDef huart6;
+
+void MX_USART6_UART_Init(void);
+
+#endif
@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""Reads the firmware's runtime counters over the packet UART.
+
+    ./stats_query.py /dev/ttyUSB0 --addr 0x03
+    ./stats_query.py /dev/pts/N --watch 1       # every second
+
+Sends a PACKET_TYPE_STATS frame and decodes the reply, which arrives on the
+log stream between text lines. Field names follow StatsField_t in stats.h.
+"""
+import argparse
+import os
+import select
+import struct
+import sys
+import time
+
+from feed_packets import crc32_mpeg2, frame
+
+PACKET_TYPE_STATS = 0xF1
+
+FIELDS = ["uptime_ms", "rx_isr_count", "rx_isr_max_ns", "frames_accepted",
+          "frames_rejected", "frames_dropped", "crc_errors", "decode_errors",
+          "log_dropped", "cycle_count", "stage_late_max_ms", "rx_to_decode_max_us",
+          "packet_task_cpu_ms", "packet_task_stack_free", "led_task_cpu_ms",
+          "led_task_stack_free", "frames_filtered", "timed_pending", "timed_dropped",
+          "detector_calls", "greens_extended", "greens_cut", "clock_sets",
+          "cycle_phase_err_ms", "preempts", "preempts_refused", "preempt_react_max_us",
+          "frame_pool_min_free", "wakeups", "sleeps", "idle_ms",
+          "conflicts_rejected", "conflict_cache_hits", "store_writes",
+          "store_erases", "store_save_max_ms", "boot_to_light_ms",
+          "store_erase_max_ms"]
+
+
+def find_reply(buf, addr):
+    """Returns (fields, rest) for the first valid stats reply from addr."""
+    start = 0
+    while True:
+        i = buf.find(b"SOF", start)
+        if i < 0 or i + 6 > len(buf):
+            return None, buf[max(0, len(buf) - 5):] if i < 0 else buf[i:]
+        n = struct.unpack(">H", buf[i + 4:i + 6])[0]
+        end = i + 6 + n + 4 + 3
+        if end > len(buf):
+            return None, buf[i:]
+        body = buf[i + 3:i + 6 + n]
+        crc = struct.unpack(">I", buf[i + 6 + n:i + 10 + n])[0]
+        payload = body[3:]
+        if (crc == crc32_mpeg2(body) and buf[end - 3:end] == b"EOF" and body[0] == addr
+                and n >= 3 and payload[0] == PACKET_TYPE_STATS):
+            count = min(payload[2], (len(payload) - 3) // 4)
+            values = struct.unpack(">%dI" % count, payload[3:3 + 4 * count])
+            return values, buf[end:]
+        start = i + 1
+
+
+def query(fd, addr, timeout):
+    os.write(fd, frame(bytes([PACKET_TYPE_STATS]), addr))
+    buf = b""
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        r, _, _ = select.select([fd], [], [], deadline - time.monotonic())
+        if not r:
+            break
+        buf += os.read(fd, 4096)
+        values, buf = find_reply(buf, addr)
+        if values is not None:
+            return values
+    return None
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("tty")
+    ap.add_argument("--addr", type=lambda v: int(v, 0), default=0x01, help="unit address to query")
+    ap.add_argument("--watch", type=float, default=0, help="repeat every N seconds")
+    ap.add_argument("--timeout", type=float, default=1.0)
+    args = ap.parse_args()
+
+    fd = os.open(args.tty, os.O_RDWR | os.O_NOCTTY)
+    while True:
+        values = query(fd, args.addr, args.timeout)
+        if values is None:
+            print("no reply", file=sys.stderr)
+        else:
+            for i, v in enumerate(values):
+                name = FIELDS[i] if i < len(FIELDS) else "field_%d" % i
+                print("%-24s %u" % (name, v))
+            print()
+        if not args.watch:
+            return 0 if values is not None else 1
+        time.sleep(args.watch)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+"""Synchronises controller clocks to this host's clock over the packet UART.
+
+    ./timesync.py /dev/ttyUSB0 --addr 0x01 --addr 0x02      # one round each
+    ./timesync.py /dev/pts/N --addr 0x01 --watch 30         # every 30 s
+
+Each round sends a burst of PACKET_TIME_PING frames to a unit and keeps
+the exchange with the shortest round trip, which is the one least delayed
+by log output queued ahead of the pong. Offset and drift are fitted over
+the last rounds and sent back in a PACKET_TIME_SET (clock_sync.h). Shared
+time is Unix time in ms, so offset_phase cycle starts and
+PACKET_ACTIVATE_TIME_MS values mean the same instant on every controller.
+"""
+import argparse
+import os
+import select
+import struct
+import sys
+import time
+
+from feed_packets import crc32_mpeg2, frame
+
+PACKET_TYPE_TIME = 0xF5
+TIME_PING, TIME_PONG, TIME_SET = 0, 1, 2
+U32 = 0xFFFFFFFF
+
+
+def ping_payload(cookie):
+    return struct.pack(">BBI", PACKET_TYPE_TIME, TIME_PING, cookie & U32)
+
+
+def set_payload(ref_local_ms, shared_at_ref_ms, drift_ppb):
+    return struct.pack(">BBIqi", PACKET_TYPE_TIME, TIME_SET, ref_local_ms & U32,
+                       shared_at_ref_ms, drift_ppb)
+
+
+def parse_pong(payload):
+    """(cookie, rx_local_ms, tx_local_ms) or None."""
+    if len(payload) != 14 or payload[0] != PACKET_TYPE_TIME or payload[1] != TIME_PONG:
+        return None
+    return struct.unpack(">III", payload[2:])
+
+
+def find_frame(buf, addr):
+    """Returns (payload, rest) for the first valid frame from addr."""
+    start = 0
+    while True:
+        i = buf.find(b"SOF", start)
+        if i < 0 or i + 6 > len(buf):
+            return None, buf[max(0, len(buf) - 5):] if i < 0 else buf[i:]
+        n = struct.unpack(">H", buf[i + 4:i + 6])[0]
+        end = i + 6 + n + 4 + 3
+        if end > len(buf):
+            return None, buf[i:]
+        body = buf[i + 3:i + 6 + n]
+        crc = struct.unpack(">I", buf[i + 6 + n:i + 10 + n])[0]
+        if crc == crc32_mpeg2(body) and buf[end - 3:end] == b"EOF" and body[0] == addr:
+            return body[3:], buf[end:]
+        start = i + 1
+
+
+class ClockEstimator:
+    """Offset and drift of one controller's clock against the host's.
+
+    A sample is (t1, t2, t3, t4): host send, controller receive, controller
+    send, host receive. Host times are Unix ms; controller times are its
+    wrapping u32 ms, unwrapped here.
+    """
+
+    def __init__(self, window=8):
+        self.window = window
+        self.rounds = []        # (controller ms, host ms - controller ms)
+        self.wrap = 0
+        self.last_raw = None
+
+    def _unwrap(self, raw):
+        if self.last_raw is not None and raw < self.last_raw and self.last_raw - raw > 1 << 31:
+            self.wrap += 1 << 32
+        self.last_raw = raw
+        return raw + self.wrap
+
+    @staticmethod
+    def rtt(sample):
+        t1, t2, t3, t4 = sample
+        return (t4 - t1) - ((t3 - t2) & U32)
+
+    def add_round(self, samples):
+        """Keeps the shortest round trip of a burst; returns it (ms)."""
+        best = min(samples, key=self.rtt)
+        t1, t2, t3, t4 = best
+        local = self._unwrap(t2) + ((t3 - t2) & U32) / 2.0
+        self.rounds.append((local, (t1 + t4) / 2.0 - local))
+        del self.rounds[:-self.window]
+        return self.rtt(best)
+
+    def model(self):
+        """(ref_local_u32, shared_at_ref_ms, drift_ppb) for PACKET_TIME_SET."""
+        xs = [r[0] for r in self.rounds]
+        ys = [r[1] for r in self.rounds]
+        ref = int(round(xs[-1]))
+        slope = 0.0
+        if len(xs) >= 2 and xs[-1] - xs[0] > 0:
+            mx = sum(xs) / len(xs)
+            my = sum(ys) / len(ys)
+            slope = (sum((x - mx) * (y - my) for x, y in zip(xs, ys))
+                     / sum((x - mx) ** 2 for x in xs))
+        else:
+            mx, my = xs[-1], ys[-1]
+        offset = my + slope * (ref - mx)
+        drift = max(-(1 << 31), min((1 << 31) - 1, int(round(slope * 1e9))))
+        return ref & U32, int(round(ref + offset)), drift
+
+
+def shared_ms(model, local_ms):
+    """ClockSync_SharedMs() for a model, with C's truncating division."""
+    ref, shared_at_ref, drift = model
+    since = (local_ms - ref) & U32
+    if since >= 1 << 31:
+        since -= 1 << 32
+    corr = abs(since * drift) // 1000000000
+    return shared_at_ref + since + (corr if since * drift >= 0 else -corr)
+
+
+def exchange(fd, addr, cookie, timeout):
+    """One ping; returns (t1, t2, t3, t4) or None."""
+    t1 = time.time() * 1000.0
+    os.write(fd, frame(ping_payload(cookie), addr))
+    buf = b""
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        r, _, _ = select.select([fd], [], [], deadline - time.monotonic())
+        if not r:
+            break
+        buf += os.read(fd, 4096)
+        while True:
+            payload, buf = find_frame(buf, addr)
+            if payload is None:
+                break
+            pong = parse_pong(payload)
+            if pong is not None and pong[0] == cookie & U32:
+                return t1, pong[1], pong[2], time.time() * 1000.0
+    return None
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("tty")
+    ap.add_argument("--addr", type=lambda v: int(v, 0), action="append", help="unit address (repeatable)")
+    ap.add_argument("--pings", type=int, default=8, help="pings per round")
+    ap.add_argument("--window", type=int, default=8, help="rounds in the drift fit")
+    ap.add_argument("--watch", type=float, default=0, help="repeat every N seconds")
+    ap.add_argument("--timeout", type=float, default=0.5)
+    args = ap.parse_args()
+    addrs = args.addr or [0x01]
+
+    fd = os.open(args.tty, os.O_RDWR | os.O_NOCTTY)
+    est = {a: ClockEstimator(args.window) for a in addrs}
+    sent = {}
+    cookie = int(time.time())
+    while True:
+        for a in addrs:
+            samples = []
+            for _ in range(args.pings):
+                cookie += 1
+                s = exchange(fd, a, cookie, args.timeout)
+                if s is not None:
+                    samples.append(s)
+            if not samples:
+                print("0x%02x: no reply" % a, file=sys.stderr)
+                continue
+
+            rtt = est[a].add_round(samples)
+            line = "0x%02x: rtt %.1f ms" % (a, rtt)
+            if a in sent:
+                # How far the model already running on the unit was off.
+                t1, t2, t3, t4 = min(samples, key=ClockEstimator.rtt)
+                mid = t2 + ((t3 - t2) & U32) // 2
+                line += ", residual %+.1f ms" % (shared_ms(sent[a], mid) - (t1 + t4) / 2.0)
+            sent[a] = est[a].model()
+            os.write(fd, frame(set_payload(*sent[a]), a))
+            print(line + ", drift %+d ppb" % sent[a][2])
+        if not args.watch:
+            return 0
+        time.sleep(args.watch)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""Simulates timesync.py against several controllers and reports how far
+their shared clocks end up from each other.
+
+    ./timesync_sim.py                           # 4 controllers, 2 h, 30 s rounds
+    ./timesync_sim.py --controllers 8 --drift-ppm 100 --log-delay-ms 20
+
+Each simulated controller has its own boot time, a crystal off by up to
+--drift-ppm, a 1 ms tick clock, and reproduces the firmware's side of the
+exchange. The ping's receive time is backdated to the EOF, so it is exact
+to the tick. The pong waits behind a random amount of queued log output.
+The host side is timesync.py's ClockEstimator. All controllers share one
+bus at --baud. Between sync rounds the script samples every controller's
+ClockSync_SharedMs against true time and reports the spread.
+"""
+import argparse
+import random
+import sys
+
+from timesync import ClockEstimator, shared_ms, U32
+
+PING_WIRE = 3 + 3 + 6 + 4 + 3
+PONG_WIRE = 3 + 3 + 14 + 4 + 3
+
+
+class SimController:
+    def __init__(self, rng, drift_ppm, boot_ms):
+        self.rate = 1.0 + rng.uniform(-drift_ppm, drift_ppm) * 1e-6
+        self.boot_ms = boot_ms
+        self.model = None
+
+    def local(self, true_ms):
+        """Tick count in ms, as ControllerLocalMs() reads it."""
+        return int((true_ms - self.boot_ms) * self.rate) & U32
+
+    def shared(self, true_ms):
+        local = self.local(true_ms)
+        return local if self.model is None else shared_ms(self.model, local)
+
+
+def percentile(values, p):
+    s = sorted(values)
+    return s[min(len(s) - 1, int(p / 100.0 * len(s)))]
+
+
+def run(args, window):
+    rng = random.Random(args.seed)
+    byte_ms = 10000.0 / args.baud
+    ctrls = [SimController(rng, args.drift_ppm, -rng.uniform(0, 3.6e6)) for _ in range(args.controllers)]
+    ests = [ClockEstimator(window) for _ in ctrls]
+
+    epoch = 1.7e12                      # host Unix ms at the start
+    t = 0.0
+    spread, vs_host = [], []
+    next_round = 0.0
+    end = args.hours * 3.6e6
+    while t < end:
+        if t >= next_round:
+            for c, est in zip(ctrls, ests):
+                samples = []
+                for _ in range(args.pings):
+                    t1 = t
+                    rx = t1 + PING_WIRE * byte_ms
+                    tx = rx + rng.uniform(0, 1.0) + rng.expovariate(1.0 / args.log_delay_ms)
+                    t4 = tx + PONG_WIRE * byte_ms
+                    samples.append((epoch + t1, c.local(rx), c.local(tx), epoch + t4))
+                    t = t4 + 1.0
+                est.add_round(samples)
+                c.model = est.model()
+            next_round += args.interval_s * 1000.0
+
+        if t > args.settle_s * 1000.0:
+            readings = [c.shared(t) for c in ctrls]
+            spread.append(max(readings) - min(readings))
+            vs_host.extend(abs(r - (epoch + t)) for r in readings)
+        t += rng.uniform(50.0, 1000.0)
+
+    return spread, vs_host
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--controllers", type=int, default=4)
+    ap.add_argument("--hours", type=float, default=2.0)
+    ap.add_argument("--interval-s", type=float, default=30.0, help="seconds between sync rounds")
+    ap.add_argument("--pings", type=int, default=8)
+    ap.add_argument("--window", type=int, default=8)
+    ap.add_argument("--drift-ppm", type=float, default=50.0)
+    ap.add_argument("--log-delay-ms", type=float, default=5.0, help="mean log backlog ahead of a pong")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("--settle-s", type=float, default=300.0, help="ignore the first N seconds")
+    ap.add_argument("--seed", type=int, default=1)
+    args = ap.parse_args()
+
+    print("%d controllers, +/-%g ppm, %g s rounds of %d pings, mean log delay %g ms"
+          % (args.controllers, args.drift_ppm, args.interval_s, args.pings, args.log_delay_ms))
+    print("%-22s %10s %10s %10s" % ("", "p50 ms", "p99 ms", "max ms"))
+    for name, window in (("offset only", 1), ("offset + drift", args.window)):
+        spread, vs_host = run(args, window)
+        print("%-22s %10.1f %10.1f %10.1f   (between controllers)"
+              % (name, percentile(spread, 50), percentile(spread, 99), max(spread)))
+        print("%-22s %10.1f %10.1f %10.1f   (against host)"
+              % ("", percentile(vs_host, 50), percentile(vs_host, 99), max(vs_host)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
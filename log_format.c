@@ -0,0 +1,107 @@
+#include "log_format.h"
+
+const LogTokenInfo_t LogFormat_Table[LOG_TOK_COUNT] = {
+#define LOG_TOKEN(name, argc, fmt) { argc, fmt },
+#include "log_tokens.def"
+#undef LOG_TOKEN
+};
+
+static size_t PutChar(char *out, size_t size, size_t pos, char c)
+{
+    if (pos + 1 < size) out[pos] = c;
+    return pos + 1;
+}
+
+static size_t PutUnsigned(char *out, size_t size, size_t pos, uint32_t v, int minDigits)
+{
+    char tmp[10];
+    int n = 0;
+    do
+    {
+        tmp[n++] = (char)('0' + v % 10u);
+        v /= 10u;
+    } while (v != 0 || n < minDigits);
+
+    while (n > 0) pos = PutChar(out, size, pos, tmp[--n]);
+    return pos;
+}
+
+size_t LogFormat_Render(char *out, size_t size, const char *fmt, const uint32_t *argv, uint8_t argc)
+{
+    size_t pos = 0;
+    uint8_t arg = 0;
+
+    for (; *fmt != '\0'; fmt++)
+    {
+        if (*fmt != '%' || fmt[1] == '\0')
+        {
+            pos = PutChar(out, size, pos, *fmt);
+            continue;
+        }
+
+        char conv = *++fmt;
+        uint32_t v = (arg < argc) ? argv[arg] : 0;
+        if (conv != '%') arg++;
+
+        switch (conv)
+        {
+        case 'u':
+            pos = PutUnsigned(out, size, pos, v, 1);
+            break;
+        case 'd':
+            if ((int32_t)v < 0)
+            {
+                pos = PutChar(out, size, pos, '-');
+                v = 0u - v;
+            }
+            pos = PutUnsigned(out, size, pos, v, 1);
+            break;
+        case 'm':
+        {
+            uint32_t centis = v / 10u + ((v % 10u) >= 5u ? 1u : 0u);
+            pos = PutUnsigned(out, size, pos, centis / 100u, 1);
+            pos = PutChar(out, size, pos, '.');
+            pos = PutUnsigned(out, size, pos, centis % 100u, 2);
+            break;
+        }
+        case 'p':
+            pos = PutChar(out, size, pos, '[');
+            for (int bit = 11; bit >= 0; bit--)
+            {
+                pos = PutChar(out, size, pos, ((v >> bit) & 1u) ? '1' : '0');
+                if (bit != 0)
+                {
+                    pos = PutChar(out, size, pos, ',');
+                    pos = PutChar(out, size, pos, ' ');
+                }
+            }
+            pos = PutChar(out, size, pos, ']');
+            break;
+        default:
+            pos = PutChar(out, size, pos, conv);
+            break;
+        }
+    }
+
+    if (size > 0) out[(pos < size) ? pos : size - 1] = '\0';
+    return (pos < size) ? pos : size - 1;
+}
+
+size_t LogFormat_Encode(uint8_t *out, LogToken_t tok, const uint32_t *argv, uint8_t argc)
+{
+    size_t n = 0;
+    out[n++] = LOG_TOKEN_SYNC;
+    out[n++] = (uint8_t)tok;
+
+    for (uint8_t i = 0; i < argc; i++)
+    {
+        uint32_t v = argv[i];
+        while (v >= 0x80u)
+        {
+            out[n++] = (uint8_t)(v | 0x80u);
+            v >>= 7;
+        }
+        out[n++] = (uint8_t)v;
+    }
+    return n;
+}
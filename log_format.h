@@ -0,0 +1,35 @@
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+#define LOG_TOKEN(name, argc, fmt) LOG_TOK_##name,
+#include "log_tokens.def"
+#undef LOG_TOKEN
+    LOG_TOK_COUNT
+} LogToken_t;
+
+#define LOG_TOKEN_SYNC    0xA5
+#define LOG_MAX_ARGS      8
+#define LOG_MAX_TEXT      160
+
+typedef struct
+{
+    uint8_t     argc;
+    const char *fmt;
+} LogTokenInfo_t;
+
+extern const LogTokenInfo_t LogFormat_Table[LOG_TOK_COUNT];
+
+/* Expands fmt with argv (see log_tokens.def for the conversions). Always
+ * NUL-terminates; returns the number of characters written. */
+size_t LogFormat_Render(char *out, size_t size, const char *fmt, const uint32_t *argv, uint8_t argc);
+
+/* Binary record: LOG_TOKEN_SYNC, token, then each argument as an unsigned
+ * LEB128 varint. Returns the record length (at most 2 + 5 * argc). */
+size_t LogFormat_Encode(uint8_t *out, LogToken_t tok, const uint32_t *argv, uint8_t argc);
+
+#endif
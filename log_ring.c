@@ -0,0 +1,93 @@
+#include "log_ring.h"
+
+#include <string.h>
+
+#if defined(LOG_BARE_METAL)
+/* No kernel: mask interrupts with PRIMASK directly. */
+#define LOG_LOCK()   uint32_t mask = __get_PRIMASK(); __disable_irq()
+#define LOG_UNLOCK() __set_PRIMASK(mask)
+#else
+#include "FreeRTOS.h"
+#include "task.h"
+
+#define LOG_LOCK()   UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR()
+#define LOG_UNLOCK() taskEXIT_CRITICAL_FROM_ISR(mask)
+#endif
+
+static UART_HandleTypeDef *logUart = NULL;
+static uint8_t logBuf[LOG_RING_SIZE];
+static volatile uint16_t logHead = 0;
+static volatile uint16_t logTail = 0;
+static volatile uint16_t logTxLen = 0;
+static volatile uint32_t logDropped = 0;
+
+/* Called with interrupts masked. */
+static void Log_StartTx(void)
+{
+    if (logUart == NULL || logTxLen != 0 || logHead == logTail) return;
+
+    uint16_t len = (logHead > logTail) ? (uint16_t)(logHead - logTail) : (uint16_t)(LOG_RING_SIZE - logTail);
+    HAL_StatusTypeDef st = (logUart->hdmatx != NULL)
+                         ? HAL_UART_Transmit_DMA(logUart, &logBuf[logTail], len)
+                         : HAL_UART_Transmit_IT(logUart, &logBuf[logTail], len);
+    if (st == HAL_OK) logTxLen = len;
+}
+
+void Log_Init(UART_HandleTypeDef *huart)
+{
+    logUart = huart;
+}
+
+void Log_WriteBytes(const uint8_t *data, uint16_t len)
+{
+    LOG_LOCK();
+
+    uint16_t used = (uint16_t)((logHead - logTail + LOG_RING_SIZE) % LOG_RING_SIZE);
+    if (len >= LOG_RING_SIZE - used)
+    {
+        logDropped++;
+        LOG_UNLOCK();
+        return;
+    }
+
+    uint16_t first = (uint16_t)(LOG_RING_SIZE - logHead);
+    if (first > len) first = len;
+    memcpy(&logBuf[logHead], data, first);
+    memcpy(logBuf, data + first, len - first);
+    logHead = (uint16_t)((logHead + len) % LOG_RING_SIZE);
+
+    Log_StartTx();
+    LOG_UNLOCK();
+}
+
+void Log_Write(const char *msg)
+{
+    Log_WriteBytes((const uint8_t *)msg, (uint16_t)strlen(msg));
+}
+
+void Log_TxCpltHandler(UART_HandleTypeDef *huart)
+{
+    if (huart != logUart) return;
+
+    LOG_LOCK();
+    logTail = (uint16_t)((logTail + logTxLen) % LOG_RING_SIZE);
+    logTxLen = 0;
+    Log_StartTx();
+    LOG_UNLOCK();
+}
+
+void Log_Event(LogToken_t tok, const uint32_t *argv, uint8_t argc)
+{
+#if LOG_TOKENIZED
+    uint8_t rec[2 + 5 * LOG_MAX_ARGS];
+    Log_WriteBytes(rec, (uint16_t)LogFormat_Encode(rec, tok, argv, argc));
+#else
+    char text[LOG_MAX_TEXT];
+    Log_WriteBytes((const uint8_t *)text, (uint16_t)LogFormat_Render(text, sizeof(text), LogFormat_Table[tok].fmt, argv, argc));
+#endif
+}
+
+uint32_t Log_Dropped(void)
+{
+    return logDropped;
+}
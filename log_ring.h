@@ -0,0 +1,48 @@
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stdint.h>
+#include "main.h"
+#include "log_format.h"
+
+/*
+ * Asynchronous UART log. Writers append to a RAM ring and return at once;
+ * the ring drains over TX DMA (or TX interrupts when no DMA stream is
+ * linked). A message that does not fit is dropped whole and counted, so
+ * logging never blocks a task or delays a light change. Build with
+ * LOG_BARE_METAL where there is no FreeRTOS kernel.
+ */
+
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 2048
+#endif
+
+/* 0: messages are formatted on the MCU as text. 1: the firmware emits
+ * LOG_TOKEN_SYNC, token ID and varint arguments, and host/log_decode.c
+ * turns them back into text. */
+#ifndef LOG_TOKENIZED
+#define LOG_TOKENIZED 0
+#endif
+
+void Log_Init(UART_HandleTypeDef *huart);
+
+/* Callable from tasks, ISRs and before the scheduler starts. */
+void Log_Write(const char *msg);
+void Log_WriteBytes(const uint8_t *data, uint16_t len);
+
+/* Call from HAL_UART_TxCpltCallback. */
+void Log_TxCpltHandler(UART_HandleTypeDef *huart);
+
+uint32_t Log_Dropped(void);
+
+void Log_Event(LogToken_t tok, const uint32_t *argv, uint8_t argc);
+
+#define LOG_EVENT0(tok) Log_Event((tok), NULL, 0)
+#define LOG_EVENT(tok, ...)                                                              \
+    do                                                                                   \
+    {                                                                                    \
+        const uint32_t logArgs_[] = { __VA_ARGS__ };                                     \
+        Log_Event((tok), logArgs_, (uint8_t)(sizeof(logArgs_) / sizeof(logArgs_[0])));   \
+    } while (0)
+
+#endif
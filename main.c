@@ -9,139 +9,611 @@
 #include "task.h"
 #include "timers.h"
 #include "semphr.h"
+#include "queue.h"
+
+#include "perf.h"
+#include "probe.h"
+#include "packet_codec.h"
+#include "crc32.h"
+#include "conflict.h"
+#include "schedule_store.h"
+#include "flash_ram.h"
+#include "schedule.h"
+#include "frame_pool.h"
+#include "log_ring.h"
+
+/* Bus address of this controller and the groups it belongs to (bit g for
+ * PACKET_ADDR_GROUP(g)); override per unit at build time. */
+#ifndef CONTROLLER_ADDRESS
+#define CONTROLLER_ADDRESS 0x01
+#endif
+#ifndef CONTROLLER_GROUPS
+#define CONTROLLER_GROUPS 0x0001
+#endif
+
+#define RX_DMA_BUFFER_SIZE 512
+
+/* Bytes kept aside while a flash erase holds up the packet path: 500 ms
+ * (STORE_ERASE_MAX_MS) of back-to-back traffic at 115200 baud, 8N1. */
+#ifndef RX_SPILL_SIZE
+#define RX_SPILL_SIZE 5760
+#endif
+
+#define PACKET_TASK_STACK_SIZE 4096
+#define LED_TASK_STACK_SIZE    2048
+#define STORE_TASK_STACK_SIZE  1024
+
+uint8_t rxDmaBuffer[RX_DMA_BUFFER_SIZE];
+volatile uint32_t rxIsrCount = 0;
+volatile uint32_t rxIsrMaxCycles = 0;
+volatile uint32_t rxFramesDropped = 0;
+volatile uint32_t rxFramesRejected = 0;
+volatile uint32_t rxFramesFiltered = 0;
+const uint8_t gControllerAddress = CONTROLLER_ADDRESS;
+
+static uint16_t rxScanPos = 0;
+static PacketCodec_t rxCodec;
+static FrameBuf_t *rxFrame = NULL;      /* the buffer rxCodec assembles into */
+
+/* Completed frames travel to StartPacketProcessor as FrameBuf_t pointers. */
+static StaticQueue_t packetQueueCb;
+static uint8_t packetQueueStorage[FRAME_POOL_COUNT * sizeof(FrameBuf_t *)];
+QueueHandle_t xPacketQueue = NULL;
+
+/* Kernel objects are allocated statically; nothing uses the FreeRTOS heap. */
+static StaticTask_t packetTaskCb;
+static StaticTask_t ledTaskCb;
+static StaticTask_t storeTaskCb;
+static uint64_t packetTaskStack[PACKET_TASK_STACK_SIZE / sizeof(uint64_t)];
+static uint64_t ledTaskStack[LED_TASK_STACK_SIZE / sizeof(uint64_t)];
+static uint64_t storeTaskStack[STORE_TASK_STACK_SIZE / sizeof(uint64_t)];
 
-#define RX_BUFFER_SIZE 256
-
-uint8_t rxByte;
-uint8_t rxBuffer[RX_BUFFER_SIZE];
-uint16_t rxIndex = 0;
-volatile uint8_t packetReady = 0;
-
-volatile uint8_t gScheduleValid = 0;
-uint8_t gStageNum = 0;
-uint32_t gStageTimes_ms[8] = {0};
-uint32_t gStagesPattern[8] = {0};
 volatile uint8_t gCurrentStageIdx = 0;
+volatile uint32_t gStageApplyCycles = 0;
+volatile uint32_t gDetectorCalls = 0;
+volatile uint32_t gDetectorCallStamp = 0;
+
+/* Latest preemption frame and its EOF stamp; written by the RX ISR, read
+ * by StartLEDController inside a critical section. */
+PacketPreempt_t gPreemptRequest;
+uint32_t gPreemptRxStamp = 0;
 
-SemaphoreHandle_t xUART_Mutex = NULL;
-SemaphoreHandle_t xData_Mutex = NULL;
+typedef struct
+{
+    uint8_t  portIdx;
+    uint16_t pin;
+} SignalPin_t;
+
+/* Signal heads in pattern order: entry 0 is pattern bit 11 (the first light
+ * of the JSON Stages row), entry 11 is bit 0. */
+static GPIO_TypeDef * const signalPorts[SIGNAL_PORT_COUNT] = { GPIOG, GPIOF };
+static const SignalPin_t signalPins[SIGNAL_COUNT] = {
+    { 0, GPIO_PIN_2 }, { 0, GPIO_PIN_3 }, { 0, GPIO_PIN_4 },
+    { 0, GPIO_PIN_5 }, { 0, GPIO_PIN_6 }, { 0, GPIO_PIN_7 },
+    { 1, GPIO_PIN_2 }, { 1, GPIO_PIN_3 }, { 1, GPIO_PIN_4 },
+    { 1, GPIO_PIN_5 }, { 1, GPIO_PIN_6 }, { 1, GPIO_PIN_7 }
+};
+
+typedef struct
+{
+    uint8_t red;
+    uint8_t yellow;
+    uint8_t green;
+} ApproachHeads_t;
+
+/* Pattern bits of each approach's heads: consecutive signalPins entries
+ * are red, yellow and green of one approach. */
+static const ApproachHeads_t approachHeads[APPROACH_COUNT] = {
+    { 11, 10, 9 }, { 8, 7, 6 }, { 5, 4, 3 }, { 2, 1, 0 }
+};
+
+/* Vehicle detectors on PE0..PE3 (EXTI lines 0..3), one rising edge per
+ * vehicle. Detector d calls for the green of approach d, so a stage
+ * showing that green is actuated by detector d. */
+static GPIO_TypeDef * const detectorPort = GPIOE;
+static const uint16_t detectorPins[DETECTOR_COUNT] = { GPIO_PIN_0, GPIO_PIN_1, GPIO_PIN_2, GPIO_PIN_3 };
+static const IRQn_Type detectorIrqs[DETECTOR_COUNT] = { EXTI0_IRQn, EXTI1_IRQn, EXTI2_IRQn, EXTI3_IRQn };
 
 osThreadId_t packetTaskHandle = NULL;
 osThreadId_t ledTaskHandle    = NULL;
+osThreadId_t storeTaskHandle  = NULL;
 
 extern UART_HandleTypeDef huart6;
 extern void StartPacketProcessor(void *argument);
 extern void StartLEDController(void *argument);
-
-extern void InitStageTimer(void);
+extern void StartScheduleStore(void *argument);
+extern void RestoreLastKnownGood(void);
 
 void SystemClock_Config(void);
-static void PrintUART(const char *msg);
 void LED_Pins_Init(void);
-void ApplyStageToLEDs(uint32_t pattern);
+void Detector_Pins_Init(void);
+void CompileStageOutput(uint32_t pattern, StageOutput_t *out);
+uint8_t DetectorsForPattern(uint32_t pattern);
+uint32_t ClearancePattern(uint32_t from, uint32_t to, int allRed);
+void ApplyStageToLEDs(const StageOutput_t *out);
 
 static void UART_IRQ_Priority_Config(void);
+static void UART_RxDma_Start(void);
+static void UART_RxScan(uint16_t pos, BaseType_t *pxHigherPriorityTaskWoken);
+static void UART_RxByte(uint8_t byte, uint32_t stamp, BaseType_t *pxHigherPriorityTaskWoken);
+static void UART_RxFrameComplete(uint32_t stamp, BaseType_t *pxHigherPriorityTaskWoken);
+static void UART_RxPreempt(uint32_t stamp, uint16_t frameLen, BaseType_t *pxHigherPriorityTaskWoken);
+static void FlashBusy_Config(void);
 
 int main(void)
 {
     HAL_Init();
     SystemClock_Config();
+    Perf_Init();
+    FlashRam_Init();
+    Crc32_Init();
+    Conflict_Init();
+    ScheduleStore_Init();
 
     MX_GPIO_Init();
     MX_USART6_UART_Init();
     LED_Pins_Init();
+    Detector_Pins_Init();
 
     UART_IRQ_Priority_Config();
+    FlashBusy_Config();
+    Log_Init(&huart6);
 
     osKernelInitialize();
-    xUART_Mutex = xSemaphoreCreateMutex();
-    xData_Mutex = xSemaphoreCreateMutex();
+    xPacketQueue = xQueueCreateStatic(FRAME_POOL_COUNT, sizeof(FrameBuf_t *), packetQueueStorage, &packetQueueCb);
 
-    PrintUART("\r\nSTM32 Traffic Light Packet Decoder + LED Controller \r\n");
+    LOG_EVENT0(LOG_TOK_BANNER);
+    RestoreLastKnownGood();
 
-    HAL_UART_Receive_IT(&huart6, &rxByte, 1);
+    UART_RxDma_Start();
 
     const osThreadAttr_t packetTask_attributes = {
         .name = "packetTask",
-        .stack_size = 4096,
+        .cb_mem = &packetTaskCb,
+        .cb_size = sizeof(packetTaskCb),
+        .stack_mem = packetTaskStack,
+        .stack_size = sizeof(packetTaskStack),
         .priority = (osPriority_t) osPriorityHigh
     };
     const osThreadAttr_t ledTask_attributes = {
         .name = "ledTask",
-        .stack_size = 2048,
-        .priority = (osPriority_t) osPriorityNormal
+        .cb_mem = &ledTaskCb,
+        .cb_size = sizeof(ledTaskCb),
+        .stack_mem = ledTaskStack,
+        .stack_size = sizeof(ledTaskStack),
+        .priority = (osPriority_t) osPriorityRealtime
+    };
+    /* Flash writes wait behind everything else. */
+    const osThreadAttr_t storeTask_attributes = {
+        .name = "storeTask",
+        .cb_mem = &storeTaskCb,
+        .cb_size = sizeof(storeTaskCb),
+        .stack_mem = storeTaskStack,
+        .stack_size = sizeof(storeTaskStack),
+        .priority = (osPriority_t) osPriorityLow
     };
 
     packetTaskHandle = osThreadNew(StartPacketProcessor, NULL, &packetTask_attributes);
     ledTaskHandle    = osThreadNew(StartLEDController, NULL, &ledTask_attributes);
-
-    InitStageTimer();
+    storeTaskHandle  = osThreadNew(StartScheduleStore, NULL, &storeTask_attributes);
 
     osKernelStart();
 
     while (1) { }
 }
 
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+/* DMA writes USART6 bytes into rxDmaBuffer in circular mode; this runs on
+ * IDLE line, half-transfer and transfer-complete, so a frame costs one or two
+ * interrupts instead of one per byte. Size is the DMA write position. */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
 {
     if (huart->Instance == USART6)
     {
-        if (rxIndex < RX_BUFFER_SIZE)
-        {
-            rxBuffer[rxIndex++] = rxByte;
+        uint32_t isrEntry = Perf_Now();
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        rxIsrCount++;
 
-            if (rxIndex >= 3 && rxBuffer[rxIndex - 3] == 0x45 && rxBuffer[rxIndex - 2] == 0x4F && rxBuffer[rxIndex - 1] == 0x46)
-            {
-                packetReady = 1;
-            }
-        }
+        UART_RxScan((Size >= RX_DMA_BUFFER_SIZE) ? 0 : Size, &xHigherPriorityTaskWoken);
 
-        HAL_UART_Receive_IT(&huart6, &rxByte, 1);
+        uint32_t isrCycles = Perf_Now() - isrEntry;
+        if (isrCycles > rxIsrMaxCycles) rxIsrMaxCycles = isrCycles;
+        Probe_Record(PROBE_RX_ISR, isrCycles);
+        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
     }
 }
 
-static void PrintUART(const char *msg)
+/* Parses the DMA ring from rxScanPos up to the write position pos. */
+static void UART_RxScan(uint16_t pos, BaseType_t *pxHigherPriorityTaskWoken)
 {
-    if (xUART_Mutex != NULL)
+    while (rxScanPos != pos)
     {
-        if (xSemaphoreTake(xUART_Mutex, pdMS_TO_TICKS(100)) == pdTRUE)
-        {
-            HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
-            xSemaphoreGive(xUART_Mutex);
-            return;
-        }
+        uint8_t byte = rxDmaBuffer[rxScanPos];
+        if (++rxScanPos >= RX_DMA_BUFFER_SIZE) rxScanPos = 0;
+        UART_RxByte(byte, 0, pxHigherPriorityTaskWoken);
+    }
+}
+
+/* One byte into rxCodec. A frame it completes is stamped with stamp, or
+ * with the current DWT time when stamp is 0. */
+static void UART_RxByte(uint8_t byte, uint32_t stamp, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    PacketCodecResult_t res = PacketCodec_PushByte(&rxCodec, byte);
+    if (res == PACKET_FRAME)
+    {
+        UART_RxFrameComplete(stamp != 0 ? stamp : Perf_Now(), pxHigherPriorityTaskWoken);
+    }
+    else if (res == PACKET_FILTERED)
+    {
+        rxFramesFiltered++;
+    }
+    else if (res == PACKET_ERROR)
+    {
+        rxFramesRejected++;
+    }
+}
+
+/* Hands the frame rxCodec just completed (ADDR..CRC32) to
+ * StartPacketProcessor by pointer, stamped with its receive time, and
+ * points the parser at a fresh pool buffer. The packet task checks the CRC
+ * on the hardware unit and frees the buffer. With no buffer free the frame
+ * is counted and dropped, and the parser reuses its buffer. */
+static void UART_RxFrameComplete(uint32_t stamp, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    uint16_t frameLen = PacketCodec_FrameLen(&rxCodec);
+
+    if (rxCodec.length != 0 && rxCodec.frame[PACKET_HEADER_LEN] == PACKET_TYPE_PREEMPT)
+    {
+        UART_RxPreempt(stamp, frameLen, pxHigherPriorityTaskWoken);
+        return;
+    }
+
+    FrameBuf_t *next = FramePool_Alloc();
+    if (next == NULL)
+    {
+        rxFramesDropped++;
+        return;
+    }
+
+    rxFrame->rxStamp = stamp;
+    rxFrame->len = frameLen;
+    if (xPacketQueue == NULL || xQueueSendFromISR(xPacketQueue, &rxFrame, pxHigherPriorityTaskWoken) != pdTRUE)
+    {
+        FramePool_Free(next);
+        rxFramesDropped++;
+        return;
+    }
+
+    rxFrame = next;
+    PacketCodec_SetBuffer(&rxCodec, rxFrame->frame);
+}
+
+/* Preemption frames skip the frame queue and the packet task: they are
+ * checked and decoded here and reach StartLEDController as a notification,
+ * so nothing queued ahead of them can delay the reaction. */
+static void UART_RxPreempt(uint32_t stamp, uint16_t frameLen, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    PacketPreempt_t req;
+    if (!PacketCodec_VerifyIsr(rxCodec.frame, frameLen) ||
+        !PacketCodec_DecodePreempt(&rxCodec.frame[PACKET_HEADER_LEN], rxCodec.length, &req))
+    {
+        rxFramesRejected++;
+        return;
+    }
+
+    gPreemptRequest = req;
+    gPreemptRxStamp = stamp;
+    if (ledTaskHandle != NULL)
+    {
+        xTaskNotifyFromISR((TaskHandle_t)ledTaskHandle, LED_NOTIFY_PREEMPT, eSetBits, pxHigherPriorityTaskWoken);
+    }
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+    Log_TxCpltHandler(huart);
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+    if (huart->Instance == USART6)
+    {
+        UART_RxDma_Start();
     }
-    HAL_UART_Transmit(&huart6, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+}
+
+static void UART_RxDma_Start(void)
+{
+    if (huart6.hdmarx != NULL && huart6.hdmarx->Init.Mode != DMA_CIRCULAR)
+    {
+        huart6.hdmarx->Init.Mode = DMA_CIRCULAR;
+        HAL_DMA_Init(huart6.hdmarx);
+    }
+
+    rxScanPos = 0;
+    if (rxFrame == NULL) rxFrame = FramePool_Alloc();
+    PacketCodec_Init(&rxCodec, CONTROLLER_ADDRESS, CONTROLLER_GROUPS);
+    PacketCodec_SetBuffer(&rxCodec, rxFrame->frame);
+    HAL_UARTEx_ReceiveToIdle_DMA(&huart6, rxDmaBuffer, RX_DMA_BUFFER_SIZE);
 }
 
 void LED_Pins_Init(void)
 {
+    __HAL_RCC_GPIOF_CLK_ENABLE();
     __HAL_RCC_GPIOG_CLK_ENABLE();
 
+    uint32_t pins[SIGNAL_PORT_COUNT] = {0};
+    for (int i = 0; i < SIGNAL_COUNT; i++)
+    {
+        pins[signalPins[i].portIdx] |= signalPins[i].pin;
+    }
+
+    for (int p = 0; p < SIGNAL_PORT_COUNT; p++)
+    {
+        GPIO_InitTypeDef GPIO_InitStruct = {0};
+        GPIO_InitStruct.Pin = pins[p];
+        GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+        GPIO_InitStruct.Pull = GPIO_NOPULL;
+        GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+        HAL_GPIO_Init(signalPorts[p], &GPIO_InitStruct);
+
+        WRITE_REG(signalPorts[p]->BSRR, pins[p] << 16);
+    }
+}
+
+void Detector_Pins_Init(void)
+{
+    __HAL_RCC_GPIOE_CLK_ENABLE();
+
     GPIO_InitTypeDef GPIO_InitStruct = {0};
-    GPIO_InitStruct.Pin = GPIO_PIN_2 | GPIO_PIN_3 | GPIO_PIN_4 |GPIO_PIN_5 | GPIO_PIN_6 | GPIO_PIN_7;
-    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-    HAL_GPIO_Init(GPIOG, &GPIO_InitStruct);
+    for (int d = 0; d < DETECTOR_COUNT; d++)
+    {
+        GPIO_InitStruct.Pin |= detectorPins[d];
+    }
+    GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
+    GPIO_InitStruct.Pull = GPIO_PULLDOWN;
+    HAL_GPIO_Init(detectorPort, &GPIO_InitStruct);
 
-    HAL_GPIO_WritePin(GPIOG,GPIO_PIN_2 | GPIO_PIN_3 | GPIO_PIN_4 |GPIO_PIN_5 | GPIO_PIN_6 | GPIO_PIN_7,GPIO_PIN_RESET);
+    /* Same priority as the UART: within FreeRTOS's syscall range. */
+    for (int d = 0; d < DETECTOR_COUNT; d++)
+    {
+        HAL_NVIC_SetPriority(detectorIrqs[d], 5, 0);
+        HAL_NVIC_EnableIRQ(detectorIrqs[d]);
+    }
+}
+
+/* Runs in the EXTI interrupt: stamps the call and wakes StartLEDController,
+ * which re-decides the end of the current green at once. */
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+{
+    for (int d = 0; d < DETECTOR_COUNT; d++)
+    {
+        if (GPIO_Pin != detectorPins[d]) continue;
+
+        gDetectorCallStamp = Perf_Now();
+        gDetectorCalls++;
+        if (ledTaskHandle != NULL)
+        {
+            BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+            xTaskNotifyFromISR((TaskHandle_t)ledTaskHandle, 1u << d, eSetBits, &xHigherPriorityTaskWoken);
+            portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+        }
+        return;
+    }
+}
+
+#ifndef HOST_SIM
+/* The detector pins are set up here rather than in the CubeMX project, so
+ * their vectors live here too. */
+void EXTI0_IRQHandler(void) { HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_0); }
+void EXTI1_IRQHandler(void) { HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_1); }
+void EXTI2_IRQHandler(void) { HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_2); }
+void EXTI3_IRQHandler(void) { HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_3); }
+#endif
+
+/*
+ * While a flash erase runs (flash_ram.h) the USART6, its RX DMA stream and
+ * the detector EXTI lines keep interrupting, through the RAM handlers
+ * below instead of the HAL. They only collect: received bytes are copied
+ * out of the DMA ring into rxSpill before the ring can wrap over them, and
+ * detector edges are counted. FlashBusy_End then parses the bytes and
+ * wakes the LED task as the usual handlers would have, with interrupts
+ * live again. Frames completed from rxSpill are stamped with the start of
+ * the erase, so the latency probes count the whole wait.
+ */
+#define DETECTOR_LINES 0x0Fu            /* EXTI lines of detectorPins */
+
+static uint8_t rxSpill[RX_SPILL_SIZE];
+static volatile uint16_t rxSpillLen = 0;
+static volatile uint16_t rxBusyPos = 0;
+static volatile uint32_t rxSpillLost = 0;
+static volatile uint32_t busyTxIe = 0;
+static volatile uint32_t busyDetectors = 0;
+static uint32_t busyStamp = 0;
+
+#ifndef HOST_SIM
+static FLASH_RAMFUNC void FlashBusy_TakeRx(void)
+{
+    uint16_t pos = (uint16_t)(RX_DMA_BUFFER_SIZE - DMA2_Stream1->NDTR);
+    if (pos >= RX_DMA_BUFFER_SIZE) pos = 0;
+    while (rxBusyPos != pos)
+    {
+        if (rxSpillLen < RX_SPILL_SIZE)
+            rxSpill[rxSpillLen++] = rxDmaBuffer[rxBusyPos];
+        else
+            rxSpillLost++;
+        if (++rxBusyPos >= RX_DMA_BUFFER_SIZE) rxBusyPos = 0;
+    }
+}
+
+/* Reading SR then DR clears IDLE and the error flags. Log TX interrupts
+ * are held until FlashBusy_End, which is when the HAL can serve them. */
+static FLASH_RAMFUNC void FlashBusy_Usart6Irq(void)
+{
+    uint32_t sr = USART6->SR;
+    if (sr & (USART_SR_IDLE | USART_SR_ORE | USART_SR_NE | USART_SR_FE)) (void)USART6->DR;
+    busyTxIe |= USART6->CR1 & (USART_CR1_TXEIE | USART_CR1_TCIE);
+    USART6->CR1 &= ~(USART_CR1_TXEIE | USART_CR1_TCIE);
+    FlashBusy_TakeRx();
+}
+
+static FLASH_RAMFUNC void FlashBusy_RxDmaIrq(void)
+{
+    DMA2->LIFCR = DMA_LIFCR_CTCIF1 | DMA_LIFCR_CHTIF1 | DMA_LIFCR_CTEIF1 | DMA_LIFCR_CDMEIF1 | DMA_LIFCR_CFEIF1;
+    FlashBusy_TakeRx();
+}
+
+static FLASH_RAMFUNC void FlashBusy_DetectorIrq(void)
+{
+    uint32_t pr = EXTI->PR & DETECTOR_LINES;
+    EXTI->PR = pr;
+    if (pr == 0) return;
+    gDetectorCallStamp = DWT->CYCCNT;   /* Perf_Now inline, not a call into flash */
+    busyDetectors |= pr;
+    for (; pr != 0; pr &= pr - 1u)
+    {
+        gDetectorCalls++;
+    }
+}
+#endif
+
+/* Interrupts are off. */
+static void FlashBusy_Begin(void)
+{
+    rxBusyPos = rxScanPos;
+    rxSpillLen = 0;
+    rxSpillLost = 0;
+    busyTxIe = 0;
+    busyDetectors = 0;
+    busyStamp = Perf_Now();
+}
+
+static void FlashBusy_End(uint32_t ticks)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    /* First, so the tasks woken below see real time. */
+    if (ticks != 0) xTaskCatchUpTicks(ticks);
+
+    taskENTER_CRITICAL();
+#ifndef HOST_SIM
+    FlashBusy_TakeRx();
+    USART6->CR1 |= busyTxIe;
+#endif
+    if (rxSpillLost != 0)
+    {
+        /* The ring wrapped before its bytes could be moved: whatever
+         * frame they belonged to is lost, so start afresh after them. */
+        rxFramesDropped++;
+        PacketCodec_Init(&rxCodec, CONTROLLER_ADDRESS, CONTROLLER_GROUPS);
+        PacketCodec_SetBuffer(&rxCodec, rxFrame->frame);
+    }
+    for (uint16_t i = 0; i < rxSpillLen; i++)
+    {
+        UART_RxByte(rxSpill[i], busyStamp, &xHigherPriorityTaskWoken);
+    }
+    rxSpillLen = 0;
+    rxScanPos = rxBusyPos;
+    uint32_t detectors = busyDetectors;
+    busyDetectors = 0;
+    taskEXIT_CRITICAL();
+
+    if (detectors != 0 && ledTaskHandle != NULL)
+    {
+        xTaskNotify((TaskHandle_t)ledTaskHandle, detectors, eSetBits);
+    }
+    if (xHigherPriorityTaskWoken) taskYIELD();
+}
+
+static void FlashBusy_Config(void)
+{
+#ifndef HOST_SIM
+    FlashRam_AddIrq(USART6_IRQn, FlashBusy_Usart6Irq);
+    FlashRam_AddIrq(DMA2_Stream1_IRQn, FlashBusy_RxDmaIrq);
+    for (int d = 0; d < DETECTOR_COUNT; d++)
+    {
+        FlashRam_AddIrq(detectorIrqs[d], FlashBusy_DetectorIrq);
+    }
+#endif
+    FlashRam_SetHooks(FlashBusy_Begin, FlashBusy_End);
+}
+
+/* Detectors whose green head is lit in pattern (bit d for detector d). */
+uint8_t DetectorsForPattern(uint32_t pattern)
+{
+    uint8_t mask = 0;
+    for (int d = 0; d < DETECTOR_COUNT; d++)
+    {
+        if ((pattern >> approachHeads[d].green) & 1u) mask |= (uint8_t)(1u << d);
+    }
+    return mask;
 }
 
-void ApplyStageToLEDs(uint32_t p)
+/* One step of a clearance from pattern from to pattern to: an approach
+ * green in both keeps its green; one losing its green shows yellow alone,
+ * or red alone once allRed is set; the rest hold their heads from `from`
+ * during the yellow step and show red in the all-red step. */
+uint32_t ClearancePattern(uint32_t from, uint32_t to, int allRed)
 {
-    HAL_GPIO_WritePin(GPIOG, GPIO_PIN_2, ((p >> 11) & 1) ? GPIO_PIN_SET : GPIO_PIN_RESET);
-    HAL_GPIO_WritePin(GPIOG, GPIO_PIN_3, ((p >> 10) & 1) ? GPIO_PIN_SET : GPIO_PIN_RESET);
-    HAL_GPIO_WritePin(GPIOG, GPIO_PIN_4, ((p >> 9)  & 1) ? GPIO_PIN_SET : GPIO_PIN_RESET);
-    HAL_GPIO_WritePin(GPIOG, GPIO_PIN_5, ((p >> 8)  & 1) ? GPIO_PIN_SET : GPIO_PIN_RESET);
-    HAL_GPIO_WritePin(GPIOG, GPIO_PIN_6, ((p >> 7)  & 1) ? GPIO_PIN_SET : GPIO_PIN_RESET);
-    HAL_GPIO_WritePin(GPIOG, GPIO_PIN_7, ((p >> 6)  & 1) ? GPIO_PIN_SET : GPIO_PIN_RESET);
+    uint32_t out = 0;
+    for (int a = 0; a < APPROACH_COUNT; a++)
+    {
+        const ApproachHeads_t *h = &approachHeads[a];
+        uint32_t red = 1u << h->red;
+        uint32_t yellow = 1u << h->yellow;
+        uint32_t green = 1u << h->green;
+
+        if ((from & green) && (to & green))
+            out |= green;
+        else if (allRed)
+            out |= red;
+        else if (from & green)
+            out |= yellow;
+        else
+            out |= from & (red | yellow | green);
+    }
+    return out;
+}
+
+void CompileStageOutput(uint32_t pattern, StageOutput_t *out)
+{
+    for (int p = 0; p < SIGNAL_PORT_COUNT; p++)
+    {
+        out->bsrr[p] = 0;
+    }
+
+    for (int i = 0; i < SIGNAL_COUNT; i++)
+    {
+        const SignalPin_t *sp = &signalPins[i];
+        if ((pattern >> (SIGNAL_COUNT - 1 - i)) & 1u)
+            out->bsrr[sp->portIdx] |= sp->pin;
+        else
+            out->bsrr[sp->portIdx] |= (uint32_t)sp->pin << 16;
+    }
+}
+
+/* Every signal head on a port switches in the same bus write, so a stage
+ * change never passes through intermediate light combinations. */
+void ApplyStageToLEDs(const StageOutput_t *out)
+{
+    uint32_t t0 = Perf_Now();
+
+    for (int p = 0; p < SIGNAL_PORT_COUNT; p++)
+    {
+        WRITE_REG(signalPorts[p]->BSRR, out->bsrr[p]);
+    }
+
+    gStageApplyCycles = Perf_Now() - t0;
+    Probe_Record(PROBE_GPIO_WRITE, gStageApplyCycles);
 }
 
 static void UART_IRQ_Priority_Config(void)
 {
     HAL_NVIC_SetPriority(USART6_IRQn, 5, 0);
     HAL_NVIC_EnableIRQ(USART6_IRQn);
+    HAL_NVIC_SetPriority(DMA2_Stream1_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream1_IRQn);
+    HAL_NVIC_SetPriority(DMA2_Stream6_IRQn, 6, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream6_IRQn);
 }
 
 void SystemClock_Config(void)
@@ -0,0 +1,337 @@
+#include "packet_codec.h"
+#include "crc32.h"
+
+#include <string.h>
+
+static uint32_t ReadU32BE(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void WriteU32BE(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static int ReadVarint(const uint8_t *p, uint16_t len, uint16_t *idx, uint32_t *out)
+{
+    uint32_t v = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7)
+    {
+        if (*idx >= len) return 0;
+        uint8_t b = p[(*idx)++];
+        if (shift == 28 && (b & 0x70u)) return 0;   /* more than 32 bits */
+        v |= (uint32_t)(b & 0x7Fu) << shift;
+        if ((b & 0x80u) == 0)
+        {
+            *out = v;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void PacketCodec_Init(PacketCodec_t *codec, uint8_t address, uint16_t groupMask)
+{
+    codec->address = address;
+    codec->groupMask = groupMask;
+    codec->skip = 0;
+    codec->state = PACKET_RX_SOF0;
+    codec->length = 0;
+    codec->count = 0;
+}
+
+PacketCodecResult_t PacketCodec_PushByte(PacketCodec_t *codec, uint8_t byte)
+{
+    switch (codec->state)
+    {
+    case PACKET_RX_SOF0:
+        if (byte == PACKET_SOF0) codec->state = PACKET_RX_SOF1;
+        return PACKET_NONE;
+
+    case PACKET_RX_SOF1:
+        codec->state = (byte == PACKET_SOF1) ? PACKET_RX_SOF2 : (byte == PACKET_SOF0) ? PACKET_RX_SOF1 : PACKET_RX_SOF0;
+        return PACKET_NONE;
+
+    case PACKET_RX_SOF2:
+        codec->state = (byte == PACKET_SOF2) ? PACKET_RX_ADDR : (byte == PACKET_SOF0) ? PACKET_RX_SOF1 : PACKET_RX_SOF0;
+        return PACKET_NONE;
+
+    /* Frames for other controllers are only counted, never stored: the
+     * address is matched before anything is written. */
+    case PACKET_RX_ADDR:
+        codec->skip = !PacketCodec_AddressMatch(codec, byte);
+        if (!codec->skip) codec->frame[0] = byte;
+        codec->state = PACKET_RX_LEN_HI;
+        return PACKET_NONE;
+
+    case PACKET_RX_LEN_HI:
+        if (!codec->skip) codec->frame[1] = byte;
+        codec->length = (uint16_t)byte << 8;
+        codec->state = PACKET_RX_LEN_LO;
+        return PACKET_NONE;
+
+    case PACKET_RX_LEN_LO:
+        if (!codec->skip) codec->frame[2] = byte;
+        codec->length |= byte;
+        codec->count = PACKET_HEADER_LEN;
+        if (codec->length == 0 || codec->length > PACKET_MAX_PAYLOAD)
+        {
+            codec->state = PACKET_RX_SOF0;
+            return PACKET_ERROR;
+        }
+        codec->state = PACKET_RX_BODY;
+        return PACKET_NONE;
+
+    case PACKET_RX_BODY:
+        if (!codec->skip) codec->frame[codec->count] = byte;
+        codec->count++;
+        if (codec->count >= PacketCodec_FrameLen(codec)) codec->state = PACKET_RX_EOF0;
+        return PACKET_NONE;
+
+    case PACKET_RX_EOF0:
+        if (byte != PACKET_EOF0) break;
+        codec->state = PACKET_RX_EOF1;
+        return PACKET_NONE;
+
+    case PACKET_RX_EOF1:
+        if (byte != PACKET_EOF1) break;
+        codec->state = PACKET_RX_EOF2;
+        return PACKET_NONE;
+
+    case PACKET_RX_EOF2:
+        if (byte != PACKET_EOF2) break;
+        codec->state = PACKET_RX_SOF0;
+        return codec->skip ? PACKET_FILTERED : PACKET_FRAME;
+
+    default:
+        break;
+    }
+
+    /* Bad trailer: drop the frame and let this byte start the next SOF. */
+    codec->state = (byte == PACKET_SOF0) ? PACKET_RX_SOF1 : PACKET_RX_SOF0;
+    return PACKET_ERROR;
+}
+
+int PacketCodec_Verify(const uint8_t *frame, uint16_t frameLen)
+{
+    if (frameLen <= PACKET_HEADER_LEN + PACKET_CRC_LEN) return 0;
+
+    uint16_t covered = (uint16_t)(frameLen - PACKET_CRC_LEN);
+    uint32_t expected = ReadU32BE(&frame[covered]);
+    return Crc32_Compute(frame, covered) == expected;
+}
+
+int PacketCodec_VerifyIsr(const uint8_t *frame, uint16_t frameLen)
+{
+    if (frameLen <= PACKET_HEADER_LEN + PACKET_CRC_LEN) return 0;
+
+    uint16_t covered = (uint16_t)(frameLen - PACKET_CRC_LEN);
+    uint32_t expected = ReadU32BE(&frame[covered]);
+    return Crc32_Update(CRC32_INIT, frame, covered) == expected;
+}
+
+uint16_t PacketCodec_Encode(uint8_t addr, const uint8_t *payload, uint16_t len, uint8_t *out)
+{
+    uint16_t idx = 0;
+    out[idx++] = PACKET_SOF0;
+    out[idx++] = PACKET_SOF1;
+    out[idx++] = PACKET_SOF2;
+    out[idx++] = addr;
+    out[idx++] = (uint8_t)(len >> 8);
+    out[idx++] = (uint8_t)len;
+    memcpy(&out[idx], payload, len);
+    idx += len;
+
+    WriteU32BE(&out[idx], Crc32_Compute(&out[3], (uint32_t)(PACKET_HEADER_LEN + len)));
+    idx += PACKET_CRC_LEN;
+
+    out[idx++] = PACKET_EOF0;
+    out[idx++] = PACKET_EOF1;
+    out[idx++] = PACKET_EOF2;
+    return idx;
+}
+
+static int DecodeCompact(const uint8_t *payload, uint16_t len, PacketSchedule_t *out)
+{
+    if (len < 6) return 0;
+    if (payload[1] != PACKET_COMPACT_VERSION && payload[1] != PACKET_COMPACT_VERSION_V1) return 0;
+
+    memset(out, 0, sizeof(*out));
+
+    out->stageNum = payload[2];
+    out->maxLight = payload[3];
+    out->greenExt = payload[4];
+    out->interrupt = payload[5];
+    if (out->stageNum == 0 || out->stageNum > PACKET_MAX_STAGES) return 0;
+    if (out->maxLight == 0 || out->maxLight > 32) return 0;
+
+    uint16_t idx = 6;
+    for (int i = 0; i < out->stageNum; i++)
+    {
+        if (!ReadVarint(payload, len, &idx, &out->stageTimes_ms[i])) return 0;
+    }
+
+    uint32_t bitCount = (uint32_t)out->stageNum * out->maxLight;
+    uint32_t patternEnd = (uint32_t)idx + (bitCount + 7u) / 8u;
+    if (patternEnd > len) return 0;
+    if (payload[1] == PACKET_COMPACT_VERSION_V1 && patternEnd != len) return 0;
+
+    uint32_t bitPos = 0;
+    for (int i = 0; i < out->stageNum; i++)
+    {
+        uint32_t v = 0;
+        for (int b = 0; b < out->maxLight; b++, bitPos++)
+        {
+            uint8_t byte = payload[idx + bitPos / 8u];
+            v = (v << 1) | ((byte >> (7u - bitPos % 8u)) & 1u);
+        }
+        out->stages[i] = v;
+    }
+
+    if (payload[1] == PACKET_COMPACT_VERSION_V1) return 1;
+
+    idx = (uint16_t)patternEnd;
+    if (!ReadVarint(payload, len, &idx, &out->offsetTol_ms)) return 0;
+    if (!ReadVarint(payload, len, &idx, &out->offsetMaxDed_ms)) return 0;
+    if (!ReadVarint(payload, len, &idx, &out->offsetMaxExt_ms)) return 0;
+    if (!ReadVarint(payload, len, &idx, &out->offsetPhase_ms)) return 0;
+    return idx == len;
+}
+
+int PacketCodec_Decode(const uint8_t *payload, uint16_t len, PacketSchedule_t *out)
+{
+    if (len != 0 && payload[0] == PACKET_TYPE_COMPACT) return DecodeCompact(payload, len, out);
+    if (len < PACKET_LEGACY_PAYLOAD_LEN) return 0;
+
+    memset(out, 0, sizeof(*out));
+
+    uint16_t idx = 0;
+    out->stageNum = payload[idx++];
+    out->maxLight = payload[idx++];
+    if (out->stageNum == 0 || out->stageNum > PACKET_LEGACY_STAGES) return 0;
+    if (out->maxLight == 0 || out->maxLight > 32) return 0;
+
+    for (int i = 0; i < PACKET_LEGACY_STAGES; i++, idx += 4)
+    {
+        out->stageTimes_ms[i] = ReadU32BE(&payload[idx]);
+    }
+    for (int i = 0; i < PACKET_LEGACY_STAGES; i++, idx += 4)
+    {
+        out->stages[i] = ReadU32BE(&payload[idx]);
+    }
+
+    out->greenExt = payload[idx++];
+    out->interrupt = payload[idx++];
+    return 1;
+}
+
+int PacketCodec_DecodeTimed(const uint8_t *payload, uint16_t len, uint8_t *when, uint32_t *at, PacketSchedule_t *out)
+{
+    if (len <= PACKET_TIMED_HEADER_LEN || payload[0] != PACKET_TYPE_TIMED) return 0;
+    if (payload[1] != PACKET_ACTIVATE_CYCLE && payload[1] != PACKET_ACTIVATE_TIME_MS) return 0;
+
+    *when = payload[1];
+    *at = ReadU32BE(&payload[2]);
+    return PacketCodec_Decode(&payload[PACKET_TIMED_HEADER_LEN], (uint16_t)(len - PACKET_TIMED_HEADER_LEN), out);
+}
+
+int PacketCodec_DecodePreempt(const uint8_t *payload, uint16_t len, PacketPreempt_t *out)
+{
+    if (len < 2 || payload[0] != PACKET_TYPE_PREEMPT) return 0;
+
+    out->action = payload[1];
+    out->pattern = 0;
+    out->hold_ms = 0;
+    if (out->action == PACKET_PREEMPT_CLEAR) return len == PACKET_PREEMPT_CLEAR_LEN;
+    if (out->action != PACKET_PREEMPT_START || len != PACKET_PREEMPT_START_LEN) return 0;
+
+    out->pattern = ReadU32BE(&payload[2]);
+    out->hold_ms = ReadU32BE(&payload[6]);
+    return 1;
+}
+
+int PacketCodec_DecodeTime(const uint8_t *payload, uint16_t len, PacketTime_t *out)
+{
+    if (len < 2 || payload[0] != PACKET_TYPE_TIME) return 0;
+
+    memset(out, 0, sizeof(*out));
+    out->kind = payload[1];
+    switch (out->kind)
+    {
+    case PACKET_TIME_PING:
+        if (len != PACKET_TIME_PING_LEN) return 0;
+        out->cookie = ReadU32BE(&payload[2]);
+        return 1;
+
+    case PACKET_TIME_SET:
+        if (len != PACKET_TIME_SET_LEN) return 0;
+        out->refLocalMs = ReadU32BE(&payload[2]);
+        out->sharedAtRefMs = (int64_t)(((uint64_t)ReadU32BE(&payload[6]) << 32) | ReadU32BE(&payload[10]));
+        out->driftPpb = (int32_t)ReadU32BE(&payload[14]);
+        return 1;
+
+    default:
+        return 0;
+    }
+}
+
+uint16_t PacketCodec_EncodeTimePong(uint32_t cookie, uint32_t rxLocalMs, uint32_t txLocalMs, uint8_t *out)
+{
+    out[0] = PACKET_TYPE_TIME;
+    out[1] = PACKET_TIME_PONG;
+    WriteU32BE(&out[2], cookie);
+    WriteU32BE(&out[6], rxLocalMs);
+    WriteU32BE(&out[10], txLocalMs);
+    return PACKET_TIME_PONG_LEN;
+}
+
+int PacketCodec_ApplyDelta(const uint8_t *payload, uint16_t len, PacketSchedule_t *sched)
+{
+    if (len < 4 || payload[0] != PACKET_TYPE_DELTA) return 0;
+
+    uint8_t flags = payload[1];
+    uint8_t first = payload[2];
+    uint8_t count = payload[3];
+    uint16_t idx = 4;
+    uint8_t oldNum = sched->stageNum;
+
+    /* A flag this decoder does not know may announce fields it would
+     * misread as the ones it does. */
+    if (flags & ~PACKET_DELTA_FLAGS) return 0;
+    /* Patterns travel as u16, so wider schedules cannot be patched. */
+    if ((flags & PACKET_DELTA_PATTERN) && sched->maxLight > 16) return 0;
+    if (flags & PACKET_DELTA_STAGE_NUM)
+    {
+        if (idx >= len) return 0;
+        sched->stageNum = payload[idx++];
+        if (sched->stageNum == 0 || sched->stageNum > PACKET_MAX_STAGES) return 0;
+    }
+    if ((uint16_t)first + count > sched->stageNum) return 0;
+
+    /* Stages added by a longer StageNum must all be written in full. */
+    if (sched->stageNum > oldNum &&
+        (first > oldNum || (uint16_t)first + count < sched->stageNum ||
+         (flags & (PACKET_DELTA_TIME | PACKET_DELTA_PATTERN)) != (PACKET_DELTA_TIME | PACKET_DELTA_PATTERN)))
+        return 0;
+
+    for (uint8_t i = first; i < first + count; i++)
+    {
+        if (flags & PACKET_DELTA_TIME)
+        {
+            if (!ReadVarint(payload, len, &idx, &sched->stageTimes_ms[i])) return 0;
+        }
+        if (flags & PACKET_DELTA_PATTERN)
+        {
+            if (idx + 2 > len) return 0;
+            sched->stages[i] = ((uint32_t)payload[idx] << 8) | payload[idx + 1];
+            idx += 2;
+            /* No wider than MaxLight, as the compact decoder reads them. */
+            if (sched->maxLight < 16 && (sched->stages[i] >> sched->maxLight) != 0) return 0;
+        }
+    }
+    return idx == len;
+}
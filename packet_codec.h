@@ -0,0 +1,263 @@
+#ifndef PACKET_CODEC_H
+#define PACKET_CODEC_H
+
+#include <stdint.h>
+
+/*
+ * Wire format shared by the Raspberry Pi encoder and every firmware variant:
+ *
+ *   'S' 'O' 'F' | ADDR | LEN_HI LEN_LO | PAYLOAD[LEN] | CRC32[4] | 'E' 'O' 'F'
+ *
+ * CRC32 is CRC-32/MPEG-2 (see crc32.h) over ADDR..PAYLOAD, sent big-endian.
+ * The codec is fed one byte at a time (from an ISR or a main loop), does
+ * constant work per byte, and resynchronises on the next SOF after garbage.
+ *
+ * ADDR lets several controllers share one bus. Host-to-controller frames
+ * carry the destination: a unit address, a group address or broadcast.
+ * Replies carry the sender's unit address. A codec only buffers frames
+ * addressed to it; everything else is counted past byte by byte and
+ * reported as PACKET_FILTERED without touching the frame buffer. A codec
+ * given PACKET_ADDR_MONITOR accepts every frame (host bus monitors).
+ */
+
+#define PACKET_SOF0 0x53
+#define PACKET_SOF1 0x4F
+#define PACKET_SOF2 0x46
+#define PACKET_EOF0 0x45
+#define PACKET_EOF1 0x4F
+#define PACKET_EOF2 0x46
+
+#define PACKET_ADDR_MONITOR       0x00
+#define PACKET_ADDR_UNIT_MIN      0x01
+#define PACKET_ADDR_UNIT_MAX      0xEF
+#define PACKET_ADDR_GROUP_BASE    0xF0  /* 0xF0..0xFE: groups 0..14 */
+#define PACKET_ADDR_BROADCAST     0xFF
+#define PACKET_ADDR_GROUP(g)      ((uint8_t)(PACKET_ADDR_GROUP_BASE + (g)))
+
+#define PACKET_MAX_PAYLOAD        256
+#define PACKET_HEADER_LEN         3
+#define PACKET_CRC_LEN            4
+#define PACKET_MAX_FRAME          (PACKET_HEADER_LEN + PACKET_MAX_PAYLOAD + PACKET_CRC_LEN)
+#define PACKET_MAX_STAGES         32
+#define PACKET_LEGACY_STAGES      8
+#define PACKET_LEGACY_PAYLOAD_LEN (2 + 4 * PACKET_LEGACY_STAGES + 4 * PACKET_LEGACY_STAGES + 2)
+#define PACKET_WIRE_LEN(payload)  (3 + PACKET_HEADER_LEN + (payload) + PACKET_CRC_LEN + 3)
+
+/*
+ * A legacy schedule payload starts with StageNum (1..PACKET_LEGACY_STAGES)
+ * and always carries PACKET_LEGACY_STAGES 32-bit times and patterns.
+ * A first byte of PACKET_TYPE_MIN or above instead names a typed frame:
+ *
+ *   PACKET_TYPE_STATS  host -> MCU: the type byte alone.
+ *                      MCU -> host: type, version, field count N, then N
+ *                      big-endian u32 counters in StatsField_t order.
+ *
+ *   PACKET_TYPE_DELTA  type, flags, first stage, stage count, [StageNum],
+ *                      then per stage [duration ms as a varint]
+ *                      [pattern as u16 BE], as selected by the flags.
+ *                      Patches the schedule last accepted by the firmware.
+ *                      Patterns are rejected when its MaxLight exceeds 16,
+ *                      or when they set a bit at or above MaxLight; unknown
+ *                      flag bits reject the frame. A larger StageNum must
+ *                      come with both the time and the pattern of every
+ *                      stage it adds.
+ *
+ *   PACKET_TYPE_COMPACT type, version (PACKET_COMPACT_VERSION), StageNum,
+ *                      MaxLight, green_Ext, Interrupt, StageNum durations
+ *                      in ms as varints, then StageNum patterns of MaxLight
+ *                      bits each, packed MSB first and zero-padded to a byte.
+ *                      Version 2 appends offset_tol, offset_maxDed,
+ *                      offset_maxExt and offset_phase in ms as varints;
+ *                      version 1 frames decode with those set to 0.
+ *
+ *   PACKET_TYPE_TIMED  type, activation kind (PACKET_ACTIVATE_*), activation
+ *                      value as u32 BE, then a legacy or compact schedule
+ *                      payload. Queued until the activation point instead of
+ *                      replacing the running schedule at the next cycle.
+ *
+ *   PACKET_TYPE_TIME   type, kind (PACKET_TIME_*), then by kind:
+ *                      PING host -> MCU: cookie, u32 BE, echoed back.
+ *                      PONG MCU -> host: cookie, then the controller ms at
+ *                           which the ping was received and the pong sent,
+ *                           u32 BE each.
+ *                      SET  host -> MCU: a controller ms reference u32 BE,
+ *                           the shared time at that reference in ms u64 BE
+ *                           and the controller's drift in ppb, i32 BE
+ *                           (clock_sync.h).
+ *
+ *   PACKET_TYPE_PREEMPT type, action (PACKET_PREEMPT_*), then for START the
+ *                      preemption pattern u32 BE and the longest time to
+ *                      hold it in ms, u32 BE (0: the firmware's limit).
+ *                      Checked and decoded in the RX ISR itself and handed
+ *                      straight to the LED controller.
+ *
+ * Varints are unsigned LEB128: 7 bits per byte, low group first, high bit
+ * set on every byte but the last.
+ */
+#define PACKET_TYPE_LEGACY 0x00
+#define PACKET_TYPE_MIN    0xF0
+#define PACKET_TYPE_STATS  0xF1
+#define PACKET_TYPE_DELTA  0xF2
+#define PACKET_TYPE_COMPACT 0xF3
+#define PACKET_TYPE_TIMED  0xF4
+#define PACKET_TYPE_TIME   0xF5
+#define PACKET_TYPE_PREEMPT 0xF6
+
+#define PACKET_ACTIVATE_CYCLE   0   /* start of cycle number N              */
+#define PACKET_ACTIVATE_TIME_MS 1   /* first stage boundary at controller ms */
+#define PACKET_TIMED_HEADER_LEN 6
+
+#define PACKET_TIME_PING     0
+#define PACKET_TIME_PONG     1
+#define PACKET_TIME_SET      2
+#define PACKET_TIME_PING_LEN 6
+#define PACKET_TIME_PONG_LEN 14
+#define PACKET_TIME_SET_LEN  18
+
+#define PACKET_PREEMPT_CLEAR     0
+#define PACKET_PREEMPT_START     1
+#define PACKET_PREEMPT_CLEAR_LEN 2
+#define PACKET_PREEMPT_START_LEN 10
+
+#define PACKET_COMPACT_VERSION    2
+#define PACKET_COMPACT_VERSION_V1 1
+
+#define PACKET_DELTA_TIME      0x01
+#define PACKET_DELTA_PATTERN   0x02
+#define PACKET_DELTA_STAGE_NUM 0x04
+#define PACKET_DELTA_FLAGS     (PACKET_DELTA_TIME | PACKET_DELTA_PATTERN | PACKET_DELTA_STAGE_NUM)
+
+typedef enum
+{
+    PACKET_RX_SOF0 = 0,
+    PACKET_RX_SOF1,
+    PACKET_RX_SOF2,
+    PACKET_RX_ADDR,
+    PACKET_RX_LEN_HI,
+    PACKET_RX_LEN_LO,
+    PACKET_RX_BODY,
+    PACKET_RX_EOF0,
+    PACKET_RX_EOF1,
+    PACKET_RX_EOF2
+} PacketRxState_t;
+
+typedef enum
+{
+    PACKET_NONE = 0,
+    PACKET_FRAME,
+    PACKET_FILTERED,
+    PACKET_ERROR
+} PacketCodecResult_t;
+
+typedef struct
+{
+    PacketRxState_t state;
+    uint8_t  address;
+    uint8_t  skip;
+    uint16_t groupMask;
+    uint16_t length;
+    uint16_t count;
+    uint8_t  *frame;            /* PACKET_MAX_FRAME bytes, PacketCodec_SetBuffer */
+} PacketCodec_t;
+
+typedef struct
+{
+    uint8_t  stageNum;
+    uint8_t  maxLight;
+    uint32_t stageTimes_ms[PACKET_MAX_STAGES];
+    uint32_t stages[PACKET_MAX_STAGES];
+    uint8_t  greenExt;
+    uint8_t  interrupt;
+    uint32_t offsetTol_ms;      /* actuation limits, compact version 2 only */
+    uint32_t offsetMaxDed_ms;
+    uint32_t offsetMaxExt_ms;
+    uint32_t offsetPhase_ms;
+} PacketSchedule_t;
+
+typedef struct
+{
+    uint8_t  kind;
+    uint32_t cookie;            /* PING */
+    uint32_t refLocalMs;        /* SET  */
+    int64_t  sharedAtRefMs;
+    int32_t  driftPpb;
+} PacketTime_t;
+
+typedef struct
+{
+    uint8_t  action;
+    uint32_t pattern;
+    uint32_t hold_ms;
+} PacketPreempt_t;
+
+/* address is this controller's unit address; bit g of groupMask joins
+ * group g. Broadcast frames are always accepted. The frame buffer is left
+ * as it was; set one before the first byte is pushed. */
+void PacketCodec_Init(PacketCodec_t *codec, uint8_t address, uint16_t groupMask);
+
+/* Frames are assembled in frame (PACKET_MAX_FRAME bytes) from the next SOF
+ * on. The caller owns it, and may swap in another buffer after each
+ * PACKET_FRAME so the completed one can be handed on without a copy. */
+static inline void PacketCodec_SetBuffer(PacketCodec_t *codec, uint8_t *frame)
+{
+    codec->frame = frame;
+}
+
+static inline int PacketCodec_AddressMatch(const PacketCodec_t *codec, uint8_t addr)
+{
+    if (addr == PACKET_ADDR_BROADCAST || addr == codec->address) return 1;
+    if (codec->address == PACKET_ADDR_MONITOR) return 1;
+    return addr >= PACKET_ADDR_GROUP_BASE && ((codec->groupMask >> (addr - PACKET_ADDR_GROUP_BASE)) & 1u);
+}
+
+/* Returns PACKET_FRAME when codec->frame holds ADDR..CRC32 of a complete
+ * frame (PacketCodec_FrameLen bytes, payload of codec->length bytes at
+ * PACKET_HEADER_LEN); it stays valid until the next byte is pushed. The CRC
+ * is not checked here so the caller can pick the hardware or software path. */
+PacketCodecResult_t PacketCodec_PushByte(PacketCodec_t *codec, uint8_t byte);
+
+static inline uint16_t PacketCodec_FrameLen(const PacketCodec_t *codec)
+{
+    return (uint16_t)(PACKET_HEADER_LEN + codec->length + PACKET_CRC_LEN);
+}
+
+/* Returns 1 if the CRC trailer of frame (ADDR..CRC32) matches. */
+int PacketCodec_Verify(const uint8_t *frame, uint16_t frameLen);
+
+/* The same check on the software CRC, for use in an ISR while a task may
+ * be holding the CRC unit. */
+int PacketCodec_VerifyIsr(const uint8_t *frame, uint16_t frameLen);
+
+static inline uint8_t PacketCodec_Type(const uint8_t *payload, uint16_t len)
+{
+    return (len != 0 && payload[0] >= PACKET_TYPE_MIN) ? payload[0] : PACKET_TYPE_LEGACY;
+}
+
+/* Writes SOF..EOF around payload into out (PACKET_WIRE_LEN(len) bytes) and
+ * returns the length written. Uses Crc32_Compute, so call it from the task
+ * that verifies incoming frames. */
+uint16_t PacketCodec_Encode(uint8_t addr, const uint8_t *payload, uint16_t len, uint8_t *out);
+
+/* Decodes a legacy or PACKET_TYPE_COMPACT schedule payload. Returns 1 on
+ * success, 0 if the payload is malformed or out of range. */
+int PacketCodec_Decode(const uint8_t *payload, uint16_t len, PacketSchedule_t *out);
+
+/* Splits a PACKET_TYPE_TIMED payload and decodes the schedule it carries.
+ * Returns 1 on success. */
+int PacketCodec_DecodeTimed(const uint8_t *payload, uint16_t len, uint8_t *when, uint32_t *at, PacketSchedule_t *out);
+
+/* START or CLEAR payload of PACKET_TYPE_PREEMPT; 0 if malformed. */
+int PacketCodec_DecodePreempt(const uint8_t *payload, uint16_t len, PacketPreempt_t *out);
+
+/* PING or SET payload of PACKET_TYPE_TIME; 0 if malformed or another kind. */
+int PacketCodec_DecodeTime(const uint8_t *payload, uint16_t len, PacketTime_t *out);
+
+/* PONG payload into out (PACKET_TIME_PONG_LEN bytes); returns its length. */
+uint16_t PacketCodec_EncodeTimePong(uint32_t cookie, uint32_t rxLocalMs, uint32_t txLocalMs, uint8_t *out);
+
+/* Patches sched with a PACKET_TYPE_DELTA payload. Returns 1 on success;
+ * on 0 the payload was malformed or out of range and sched may be partly
+ * written, so patch a copy and keep the original on failure. */
+int PacketCodec_ApplyDelta(const uint8_t *payload, uint16_t len, PacketSchedule_t *sched);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+#include "main.h"
+
+/* Cycle-accurate timestamps from the Cortex-M4 DWT cycle counter. The host
+ * simulation counts nanoseconds instead and sets SystemCoreClock to 1 GHz,
+ * so Perf_CyclesToUs works unchanged in both builds. */
+
+#if defined(HOST_SIM)
+
+#include <time.h>
+
+static inline void Perf_Init(void)
+{
+}
+
+static inline uint32_t Perf_Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec);
+}
+
+#else
+
+static inline void Perf_Init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t Perf_Now(void)
+{
+    return DWT->CYCCNT;
+}
+
+#endif
+
+static inline uint32_t Perf_CyclesToUs(uint32_t cycles)
+{
+    return cycles / (SystemCoreClock / 1000000u);
+}
+
+static inline uint32_t Perf_CyclesToNs(uint32_t cycles)
+{
+    uint64_t ns = ((uint64_t)cycles * 1000u) / (SystemCoreClock / 1000000u);
+    return (ns > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)ns;
+}
+
+#endif
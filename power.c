@@ -0,0 +1,59 @@
+#include "power.h"
+#include "main.h"
+
+#include "task.h"
+
+static uint32_t wakeups = 0;
+static uint32_t sleeps = 0;
+static uint64_t idleTicks = 0;
+static TickType_t idleSince = 0;
+static uint8_t idleRunning = 0;
+
+/* Runs inside the scheduler's context switch, so it only reads. */
+void Power_TaskSwitchedIn(void)
+{
+    uint8_t idle = (xTaskGetCurrentTaskHandle() == xTaskGetIdleTaskHandle());
+    if (idle == idleRunning) return;
+
+    TickType_t now = xTaskGetTickCount();
+    if (idle)
+    {
+        idleSince = now;
+    }
+    else
+    {
+        idleTicks += now - idleSince;
+        wakeups++;
+    }
+    idleRunning = idle;
+}
+
+#ifndef HOST_SIM
+void Power_PreSleep(TickType_t *expectedIdle)
+{
+    (void)expectedIdle;
+    HAL_SuspendTick();
+}
+
+void Power_PostSleep(TickType_t *expectedIdle)
+{
+    (void)expectedIdle;
+    HAL_ResumeTick();
+    sleeps++;
+}
+#endif
+
+uint32_t Power_Wakeups(void)
+{
+    return wakeups;
+}
+
+uint32_t Power_Sleeps(void)
+{
+    return sleeps;
+}
+
+uint32_t Power_IdleMs(void)
+{
+    return (uint32_t)(idleTicks * 1000u / configTICK_RATE_HZ);
+}
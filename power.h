@@ -0,0 +1,44 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/*
+ * Low-power idle accounting. With configUSE_TICKLESS_IDLE the idle task
+ * stops the tick and sleeps in WFI until the next task deadline or an
+ * interrupt: a stage deadline, USART6 IDLE/DMA events, log TX completion
+ * or a detector edge. USART6 RX DMA keeps running in Sleep mode, so a
+ * frame is received without waking the core until its IDLE event. Stop
+ * mode is not used: USART6 cannot wake an F407 from it, and the clock
+ * restart would lose the first bytes of a frame.
+ *
+ * Hook these up in FreeRTOSConfig.h:
+ *
+ *   #define traceTASK_SWITCHED_IN()          Power_TaskSwitchedIn()
+ *   #define configPRE_SLEEP_PROCESSING(x)    Power_PreSleep(&(x))
+ *   #define configPOST_SLEEP_PROCESSING(x)   Power_PostSleep(&(x))
+ *
+ * Wake-ups and idle time come from task switches, so they are counted the
+ * same way in the host simulation, whose POSIX port has no tickless idle.
+ */
+
+void Power_TaskSwitchedIn(void);
+
+/* Stops the HAL time base (a TIM with FreeRTOS) so its 1 kHz interrupt
+ * does not end every sleep. */
+void Power_PreSleep(TickType_t *expectedIdle);
+void Power_PostSleep(TickType_t *expectedIdle);
+
+/* Times a task was switched in after the idle task ran. */
+uint32_t Power_Wakeups(void);
+
+/* Tickless sleeps entered; each one ends in a wake-up, including those
+ * an interrupt handles without waking a task. 0 in the host simulation. */
+uint32_t Power_Sleeps(void);
+
+/* Ticks spent in the idle task. */
+uint32_t Power_IdleMs(void);
+
+#endif
@@ -0,0 +1,83 @@
+#include "probe.h"
+
+#if PROBE_ENABLE
+
+#include "perf.h"
+#include "log_ring.h"
+
+static ProbeHist_t probes[PROBE_COUNT];
+
+/* Values 0..3 get their own bucket; above that each power of two 2^e is
+ * split into four: idx = (e - 1) * 4 + the two bits below the leading one. */
+static uint32_t Probe_BucketOf(uint32_t ns)
+{
+    if (ns < 4u) return ns;
+
+    uint32_t e = 31u - (uint32_t)__builtin_clz(ns);
+    uint32_t sub = (ns >> (e - 2u)) & 3u;
+    return (e - 1u) * 4u + sub;
+}
+
+uint32_t Probe_BucketUpperNs(uint32_t idx)
+{
+    if (idx < 4u) return idx;
+
+    uint32_t e = idx / 4u + 1u;
+    uint64_t lower = (uint64_t)(4u + idx % 4u) << (e - 2u);
+    uint64_t upper = lower + ((uint64_t)1u << (e - 2u)) - 1u;
+    return (upper > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)upper;
+}
+
+void Probe_RecordNs(ProbeId_t id, uint32_t ns)
+{
+    ProbeHist_t *h = &probes[id];
+    h->bucket[Probe_BucketOf(ns)]++;
+    h->count++;
+    if (ns > h->max_ns) h->max_ns = ns;
+}
+
+void Probe_Record(ProbeId_t id, uint32_t cycles)
+{
+    Probe_RecordNs(id, Perf_CyclesToNs(cycles));
+}
+
+const ProbeHist_t *Probe_Get(ProbeId_t id)
+{
+    return &probes[id];
+}
+
+uint32_t Probe_Percentile(const ProbeHist_t *h, uint32_t pct)
+{
+    if (h->count == 0) return 0;
+
+    uint64_t target = ((uint64_t)h->count * pct + 99u) / 100u;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < PROBE_HIST_BUCKETS; i++)
+    {
+        seen += h->bucket[i];
+        if (seen >= target)
+        {
+            uint32_t upper = Probe_BucketUpperNs(i);
+            return (upper < h->max_ns) ? upper : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+void Probe_Report(ProbeId_t id)
+{
+    const ProbeHist_t *h = &probes[id];
+
+    LOG_EVENT(LOG_TOK_PROBE_SUMMARY, (uint32_t)id, h->count,
+              Probe_Percentile(h, 50), Probe_Percentile(h, 99), h->max_ns);
+
+    for (uint32_t i = 0; i < PROBE_HIST_BUCKETS; i++)
+    {
+        if (h->bucket[i] != 0)
+        {
+            LOG_EVENT(LOG_TOK_PROBE_BUCKET, (uint32_t)id, Probe_BucketUpperNs(i), h->bucket[i]);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <stdint.h>
+
+/*
+ * Latency probes for the packet-in to light-out path. Each probe keeps a
+ * log-linear histogram of durations in nanoseconds (four buckets per power
+ * of two, so a reported percentile is at most 25% above the true value)
+ * plus the exact maximum. Timestamps come from Perf_Now: DWT CYCCNT on the
+ * target, CLOCK_MONOTONIC in the host simulation.
+ *
+ * Every probe has exactly one writer (the ISR, StartPacketProcessor or
+ * StartLEDController), so recording is lock-free and a few dozen cycles.
+ * Durations are 32-bit cycle differences and must stay below one counter
+ * wrap (25 s at 168 MHz).
+ */
+
+#ifndef PROBE_ENABLE
+#define PROBE_ENABLE 1
+#endif
+
+#define PROBE_HIST_BUCKETS 124
+
+typedef enum
+{
+    PROBE_RX_ISR = 0,       /* UART RX event callback, entry to exit          */
+    PROBE_RX_TO_DECODE,     /* EOF seen in the ISR to payload decoded         */
+    PROBE_RX_TO_PUBLISH,    /* EOF seen in the ISR to schedule published      */
+    PROBE_PUBLISH_TO_LIGHT, /* published to first GPIO write of that schedule */
+    PROBE_RX_TO_LIGHT,      /* EOF seen in the ISR to first GPIO write        */
+    PROBE_GPIO_WRITE,       /* ApplyStageToLEDs port writes                   */
+    PROBE_STAGE_JITTER,     /* |stage-to-stage interval - nominal duration|   */
+    PROBE_DETECTOR_TO_DECISION, /* detector edge to actuated green re-decided */
+    PROBE_PREEMPT_REACT,    /* preempt frame EOF to first clearance write     */
+    PROBE_COUNT
+} ProbeId_t;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t max_ns;
+    uint32_t bucket[PROBE_HIST_BUCKETS];
+} ProbeHist_t;
+
+#if PROBE_ENABLE
+
+void Probe_Record(ProbeId_t id, uint32_t cycles);
+void Probe_RecordNs(ProbeId_t id, uint32_t ns);
+
+const ProbeHist_t *Probe_Get(ProbeId_t id);
+
+/* Smallest bucket upper bound below which pct percent of samples fall. */
+uint32_t Probe_Percentile(const ProbeHist_t *h, uint32_t pct);
+
+/* Upper bound in ns of histogram bucket idx. */
+uint32_t Probe_BucketUpperNs(uint32_t idx);
+
+/* Logs one probe's summary and non-empty buckets. */
+void Probe_Report(ProbeId_t id);
+
+#else
+
+#define Probe_Record(id, cycles) ((void)0)
+#define Probe_RecordNs(id, ns)   ((void)0)
+#define Probe_Report(id)         ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,94 @@
+#include "schedule.h"
+
+#include <stddef.h>
+
+#define SCHEDULE_SLOT_FRESH 0x80u
+
+static Schedule_t slots[3];
+
+static uint8_t backIdx = 0;
+static uint8_t middleIdx = 1;
+static uint8_t frontIdx = 2;
+static uint8_t frontValid = 0;
+static uint32_t publishSeq = 0;
+
+Schedule_t *Schedule_BeginWrite(void)
+{
+    return &slots[backIdx];
+}
+
+void Schedule_Publish(void)
+{
+    slots[backIdx].sequence = ++publishSeq;
+    backIdx = __atomic_exchange_n(&middleIdx, (uint8_t)(backIdx | SCHEDULE_SLOT_FRESH), __ATOMIC_ACQ_REL) & (uint8_t)~SCHEDULE_SLOT_FRESH;
+}
+
+const Schedule_t *Schedule_AcquireLatest(void)
+{
+    if (__atomic_load_n(&middleIdx, __ATOMIC_ACQUIRE) & SCHEDULE_SLOT_FRESH)
+    {
+        frontIdx = __atomic_exchange_n(&middleIdx, frontIdx, __ATOMIC_ACQ_REL) & (uint8_t)~SCHEDULE_SLOT_FRESH;
+        frontValid = 1;
+    }
+    return frontValid ? &slots[frontIdx] : NULL;
+}
+
+typedef struct
+{
+    Schedule_t sched;
+    ScheduleActivation_t when;
+    uint32_t at;
+} ScheduleQueueEntry_t;
+
+static ScheduleQueueEntry_t queue[SCHEDULE_QUEUE_LEN];
+
+/* Pending entries are [queueRead, queueWrite); the held one, if any, is
+ * [queueFree, queueRead). */
+static uint8_t queueWrite = 0;
+static uint8_t queueRead = 0;
+static uint8_t queueFree = 0;
+
+static uint8_t ScheduleQueue_Next(uint8_t idx)
+{
+    return (uint8_t)((idx + 1u) % SCHEDULE_QUEUE_LEN);
+}
+
+Schedule_t *ScheduleQueue_BeginWrite(void)
+{
+    if (ScheduleQueue_Next(queueWrite) == __atomic_load_n(&queueFree, __ATOMIC_ACQUIRE)) return NULL;
+    return &queue[queueWrite].sched;
+}
+
+void ScheduleQueue_Commit(ScheduleActivation_t when, uint32_t at)
+{
+    queue[queueWrite].when = when;
+    queue[queueWrite].at = at;
+    queue[queueWrite].sched.sequence = ++publishSeq;
+    __atomic_store_n(&queueWrite, ScheduleQueue_Next(queueWrite), __ATOMIC_RELEASE);
+}
+
+const Schedule_t *ScheduleQueue_Peek(ScheduleActivation_t *when, uint32_t *at)
+{
+    if (queueRead == __atomic_load_n(&queueWrite, __ATOMIC_ACQUIRE)) return NULL;
+    *when = queue[queueRead].when;
+    *at = queue[queueRead].at;
+    return &queue[queueRead].sched;
+}
+
+void ScheduleQueue_Take(void)
+{
+    ScheduleQueue_Release();
+    __atomic_store_n(&queueRead, ScheduleQueue_Next(queueRead), __ATOMIC_RELAXED);
+}
+
+void ScheduleQueue_Release(void)
+{
+    __atomic_store_n(&queueFree, queueRead, __ATOMIC_RELEASE);
+}
+
+uint8_t ScheduleQueue_Pending(void)
+{
+    uint8_t w = __atomic_load_n(&queueWrite, __ATOMIC_ACQUIRE);
+    uint8_t r = __atomic_load_n(&queueRead, __ATOMIC_RELAXED);
+    return (uint8_t)((w + SCHEDULE_QUEUE_LEN - r) % SCHEDULE_QUEUE_LEN);
+}
@@ -0,0 +1,97 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdint.h>
+
+#include "packet_codec.h"
+
+#define SCHEDULE_MAX_STAGES PACKET_MAX_STAGES
+
+#define SIGNAL_COUNT       12
+#define SIGNAL_PORT_COUNT  2
+#define APPROACH_COUNT     4   /* red, yellow, green heads each */
+#define DETECTOR_COUNT     4   /* detector d serves approach d  */
+
+/* StartLEDController notification bits: bit d is a call from detector d. */
+#define LED_NOTIFY_DETECTORS ((1u << DETECTOR_COUNT) - 1u)
+#define LED_NOTIFY_SCHEDULE  (1u << 30)     /* published, queued or re-timed */
+#define LED_NOTIFY_PREEMPT   (1u << 31)
+
+/* Bits every wait consumes; LED_NOTIFY_PREEMPT stays set until the
+ * request is taken. */
+#define LED_NOTIFY_EVENTS    (LED_NOTIFY_DETECTORS | LED_NOTIFY_SCHEDULE)
+
+/* One GPIO BSRR word per output port, compiled from a stage pattern when the
+ * schedule is decoded so a stage change is a single store per port. */
+typedef struct
+{
+    uint32_t bsrr[SIGNAL_PORT_COUNT];
+} StageOutput_t;
+
+/*
+ * Immutable stage schedule. StartPacketProcessor builds one in the slot
+ * returned by Schedule_BeginWrite and publishes it; StartLEDController picks
+ * up the latest one at a cycle boundary. The three slots are exchanged with
+ * single atomic swaps (a triple buffer), so neither side ever blocks and the
+ * reader's slot is never overwritten while it is in use.
+ */
+typedef struct
+{
+    uint32_t sequence;
+    uint8_t  stageNum;
+    uint32_t stageTimes_ms[SCHEDULE_MAX_STAGES];
+    uint32_t stagesPattern[SCHEDULE_MAX_STAGES];
+    StageOutput_t stageOutputs[SCHEDULE_MAX_STAGES];
+    uint8_t  stageDetectors[SCHEDULE_MAX_STAGES];   /* bit d: detector d calls this green */
+    uint32_t gapTol_ms;     /* 0: fixed time; else end a green after this gap */
+    uint32_t maxDed_ms;     /* most a green may be cut short                 */
+    uint32_t maxExt_ms;     /* most a green may be extended                  */
+    uint32_t phase_ms;      /* offset_phase: cycle start after shared epoch  */
+    uint8_t  interrupt;     /* non-zero: PACKET_TYPE_PREEMPT may take over   */
+    uint32_t rxStamp;       /* Perf_Now() when the frame's EOF was received */
+    uint32_t publishStamp;  /* Perf_Now() just before Schedule_Publish      */
+} Schedule_t;
+
+/* Writer side (one task only). */
+Schedule_t *Schedule_BeginWrite(void);
+void Schedule_Publish(void);
+
+/* Reader side (one task only). Returns the newest published schedule, or
+ * the one already held if nothing new was published; NULL before the first
+ * publication. */
+const Schedule_t *Schedule_AcquireLatest(void);
+
+/*
+ * Bounded single-producer/single-consumer queue of schedules planned ahead,
+ * each with an activation point: the start of a given cycle number, or the
+ * first stage boundary at or after a controller time in ms. The packet task
+ * compiles an entry in place and commits it; the LED controller peeks at
+ * the oldest entry on each stage boundary and, when it is due, takes it
+ * over by pointer. Index updates are single atomic stores, so the switch
+ * costs one load and one compare and never blocks.
+ *
+ * The entry the LED controller is running stays owned by it until
+ * ScheduleQueue_Release; the queue holds SCHEDULE_QUEUE_LEN - 1 entries,
+ * counting that one.
+ */
+#define SCHEDULE_QUEUE_LEN 4
+
+typedef enum
+{
+    SCHEDULE_AT_CYCLE = 0,
+    SCHEDULE_AT_TIME_MS
+} ScheduleActivation_t;
+
+/* Writer side (one task only). BeginWrite returns NULL when full. */
+Schedule_t *ScheduleQueue_BeginWrite(void);
+void ScheduleQueue_Commit(ScheduleActivation_t when, uint32_t at);
+
+/* Reader side (one task only). Peek returns the oldest pending entry or
+ * NULL; Take makes it the held entry; Release frees the held entry. */
+const Schedule_t *ScheduleQueue_Peek(ScheduleActivation_t *when, uint32_t *at);
+void ScheduleQueue_Take(void);
+void ScheduleQueue_Release(void);
+
+uint8_t ScheduleQueue_Pending(void);
+
+#endif
@@ -0,0 +1,191 @@
+#include "schedule_store.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "main.h"
+#include "crc32.h"
+#include "flash_ram.h"
+
+#define STORE_MAGIC   0x4C4B4753u      /* "LKGS" */
+#define STORE_BLANK   0xFFFFFFFFu
+#define STORE_WORDS   (sizeof(StoreRecord_t) / 4u)
+
+#ifndef HOST_SIM
+/* Defined by STM32F407VGTX_FLASH.ld, which keeps the image out of the
+ * store's sectors. An image linked with a script that does not reserve
+ * them fails to link here instead of erasing its own code. */
+extern const uint8_t __store_start[];
+extern const uint8_t __store_end[];
+#endif
+
+static const uint32_t sectorAddr[2] = { STORE_ADDR_A, STORE_ADDR_B };
+static const uint32_t sectorId[2]   = { STORE_SECTOR_A, STORE_SECTOR_B };
+
+static const StoreRecord_t *newest = NULL;
+static uint8_t  activeSector = 0;
+static uint32_t nextSlot = 0;          /* in activeSector */
+static uint32_t nextSequence = 1;
+static uint8_t  spareBlank = 0;
+static uint8_t  usable = 0;            /* the linker reserved exactly our sectors */
+
+static uint32_t writes = 0;
+static uint32_t erases = 0;
+
+static const StoreRecord_t *Slot(uint8_t sector, uint32_t slot)
+{
+    return (const StoreRecord_t *)(uintptr_t)(sectorAddr[sector] + slot * sizeof(StoreRecord_t));
+}
+
+static uint32_t RecordCrc(const StoreRecord_t *rec)
+{
+    return Crc32_Update(CRC32_INIT, (const uint8_t *)&rec->sequence,
+                        (uint32_t)(offsetof(StoreRecord_t, crc) - offsetof(StoreRecord_t, sequence)));
+}
+
+static int RecordGood(const StoreRecord_t *rec)
+{
+    return rec->magic == STORE_MAGIC && rec->length == sizeof(PacketSchedule_t) && rec->crc == RecordCrc(rec);
+}
+
+static int WordsErased(const uint32_t *w, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (w[i] != STORE_BLANK) return 0;
+    }
+    return 1;
+}
+
+static int SlotErased(const StoreRecord_t *rec)
+{
+    return WordsErased((const uint32_t *)rec, STORE_WORDS);
+}
+
+/* Records are appended in sequence order, so a sector's used slots come
+ * first and the newest good record is the last one whose CRC checks; a
+ * torn or corrupt record still occupies its slot. Only that one record's
+ * CRC is computed. Returns the number of used slots. */
+static uint32_t ScanSector(uint8_t sector, const StoreRecord_t **best)
+{
+    uint32_t used = 0;
+    while (used < STORE_RECORDS_PER_SECTOR && Slot(sector, used)->magic != STORE_BLANK)
+    {
+        used++;
+    }
+
+    *best = NULL;
+    for (uint32_t i = used; i > 0 && *best == NULL; i--)
+    {
+        if (RecordGood(Slot(sector, i - 1u))) *best = Slot(sector, i - 1u);
+    }
+    return used;
+}
+
+void ScheduleStore_Init(void)
+{
+#ifndef HOST_SIM
+    if ((uintptr_t)__store_start != STORE_ADDR_A || (uintptr_t)__store_end != STORE_ADDR_B + STORE_SECTOR_SIZE)
+        return;
+#endif
+    usable = 1;
+
+    const StoreRecord_t *best[2];
+    uint32_t used[2];
+    for (uint8_t s = 0; s < 2; s++)
+    {
+        used[s] = ScanSector(s, &best[s]);
+    }
+
+    activeSector = (best[1] != NULL && (best[0] == NULL || (int32_t)(best[1]->sequence - best[0]->sequence) > 0)) ? 1 : 0;
+    newest = best[activeSector];
+    nextSlot = used[activeSector];
+    nextSequence = (newest != NULL) ? newest->sequence + 1u : 1u;
+    spareBlank = (uint8_t)WordsErased((const uint32_t *)(uintptr_t)sectorAddr[activeSector ^ 1u],
+                                      STORE_SECTOR_SIZE / 4u);
+}
+
+int ScheduleStore_Load(PacketSchedule_t *out)
+{
+    if (newest == NULL) return 0;
+    memcpy(out, &newest->schedule, sizeof(*out));
+    return 1;
+}
+
+int ScheduleStore_EraseDue(void)
+{
+    if (!usable || spareBlank) return 0;
+    if (newest == NULL) return 1;
+    uint32_t at = (uint32_t)(uintptr_t)newest;
+    return at >= sectorAddr[activeSector] && at < sectorAddr[activeSector] + STORE_SECTOR_SIZE;
+}
+
+int ScheduleStore_EraseSpare(void)
+{
+    if (!usable) return 0;
+
+    HAL_FLASH_Unlock();
+    int ok = FlashRam_EraseSector(sectorId[activeSector ^ 1u]);
+    HAL_FLASH_Lock();
+    if (!ok) return 0;
+    spareBlank = 1;
+    erases++;
+    return 1;
+}
+
+StoreResult_t ScheduleStore_Save(const PacketSchedule_t *pkt)
+{
+    if (!usable) return STORE_FAILED;
+    if (newest != NULL && memcmp(&newest->schedule, pkt, sizeof(*pkt)) == 0) return STORE_UNCHANGED;
+
+    static StoreRecord_t rec;
+    rec.magic = STORE_MAGIC;
+    rec.sequence = nextSequence;
+    rec.length = sizeof(PacketSchedule_t);
+    rec.schedule = *pkt;
+    rec.crc = RecordCrc(&rec);
+
+    /* Skip slots a torn write left dirty. */
+    while (nextSlot < STORE_RECORDS_PER_SECTOR && !SlotErased(Slot(activeSector, nextSlot)))
+    {
+        nextSlot++;
+    }
+    if (nextSlot >= STORE_RECORDS_PER_SECTOR)
+    {
+        if (!spareBlank) return STORE_FULL;
+        activeSector = (uint8_t)(activeSector ^ 1u);
+        nextSlot = 0;
+        spareBlank = 0;
+    }
+
+    HAL_FLASH_Unlock();
+
+    const StoreRecord_t *dst = Slot(activeSector, nextSlot++);
+    const uint32_t *src = (const uint32_t *)&rec;
+    uint32_t addr = (uint32_t)(uintptr_t)dst;
+    for (uint32_t i = 0; i < STORE_WORDS; i++)
+    {
+        if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr + 4u * i, src[i]) != HAL_OK)
+        {
+            HAL_FLASH_Lock();
+            return STORE_FAILED;
+        }
+    }
+    HAL_FLASH_Lock();
+
+    if (!RecordGood(dst)) return STORE_FAILED;
+    newest = dst;
+    nextSequence++;
+    writes++;
+    return STORE_WRITTEN;
+}
+
+uint32_t ScheduleStore_Writes(void)
+{
+    return writes;
+}
+
+uint32_t ScheduleStore_Erases(void)
+{
+    return erases;
+}
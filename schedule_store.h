@@ -0,0 +1,77 @@
+#ifndef SCHEDULE_STORE_H
+#define SCHEDULE_STORE_H
+
+#include <stdint.h>
+
+#include "packet_codec.h"
+
+/*
+ * Last-known-good schedule in flash, so the lights come back at power-up
+ * before the Pi's link is. Records are appended to one of two 16 KB
+ * sectors (2 and 3, 0x08008000-0x0800FFFF). STM32F407VGTX_FLASH.ld keeps
+ * the vector table and reset handler in sectors 0-1 and the rest of the
+ * image from 0x08010000, and defines __store_start/__store_end, which Init
+ * checks against STORE_ADDR_A/B; without them the image does not link.
+ * When the active sector is full the other one, erased beforehand by
+ * ScheduleStore_EraseSpare, takes the next record.
+ *
+ * A record is magic, sequence, length, the decoded PacketSchedule_t and a
+ * CRC-32 over sequence..schedule. Words are programmed in that order with
+ * the CRC last, so a record torn by a reset fails its CRC and the previous
+ * one is used. The newest record with a good CRC wins.
+ *
+ * Programming a word stalls every flash fetch, interrupts included, for
+ * about 16 us. Save never erases. A 16 KB erase stalls them for 250 ms
+ * typical, 500 ms at most (STM32F407 datasheet, x32 parallelism); it runs
+ * through FlashRam_EraseSector, so the interrupts registered there keep
+ * running from RAM, but tasks wait for it. It is left to the caller,
+ * which picks a moment when no task has anything due. Call both from a
+ * low-priority task only.
+ */
+
+#ifndef STORE_SECTOR_A
+#define STORE_SECTOR_A      FLASH_SECTOR_2
+#define STORE_SECTOR_B      FLASH_SECTOR_3
+#define STORE_ADDR_A        0x08008000u
+#define STORE_ADDR_B        0x0800C000u
+#endif
+#define STORE_SECTOR_SIZE   0x4000u
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t length;            /* sizeof(PacketSchedule_t) when written */
+    PacketSchedule_t schedule;
+    uint32_t crc;
+} StoreRecord_t;
+
+#define STORE_RECORDS_PER_SECTOR (STORE_SECTOR_SIZE / sizeof(StoreRecord_t))
+
+typedef enum
+{
+    STORE_UNCHANGED = 0,        /* same as the newest record; nothing written */
+    STORE_WRITTEN,
+    STORE_FULL,                 /* active sector full, spare not erased yet   */
+    STORE_FAILED
+} StoreResult_t;
+
+/* Scans both sectors for the newest good record and the next free slot. */
+void ScheduleStore_Init(void);
+
+/* Copies the newest good record; 0 if there is none. */
+int ScheduleStore_Load(PacketSchedule_t *out);
+
+StoreResult_t ScheduleStore_Save(const PacketSchedule_t *pkt);
+
+/* 1 when the spare sector holds data that is no longer needed: the newest
+ * good record is in the active sector, or there is none. */
+int ScheduleStore_EraseDue(void);
+
+/* Erases the spare sector; no task runs until it is done. 0 on failure. */
+int ScheduleStore_EraseSpare(void);
+
+uint32_t ScheduleStore_Writes(void);
+uint32_t ScheduleStore_Erases(void);
+
+#endif
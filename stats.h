@@ -0,0 +1,55 @@
+#ifndef STATS_H
+#define STATS_H
+
+/*
+ * Counters returned in a PACKET_TYPE_STATS reply, in wire order. Append
+ * new fields at the end: the reply carries its field count, so older host
+ * tools keep reading the fields they know.
+ */
+
+#define STATS_VERSION 1
+
+typedef enum
+{
+    STATS_UPTIME_MS = 0,
+    STATS_RX_ISR_COUNT,
+    STATS_RX_ISR_MAX_NS,
+    STATS_FRAMES_ACCEPTED,      /* schedules published                        */
+    STATS_FRAMES_REJECTED,      /* bad trailer in the RX ISR codec            */
+    STATS_FRAMES_DROPPED,       /* no free frame buffer (frame_pool.h)        */
+    STATS_CRC_ERRORS,
+    STATS_DECODE_ERRORS,        /* truncated or out-of-range payload          */
+    STATS_LOG_DROPPED,
+    STATS_CYCLE_COUNT,
+    STATS_STAGE_LATE_MAX_MS,
+    STATS_RX_TO_DECODE_MAX_US,
+    STATS_PACKET_TASK_CPU_MS,
+    STATS_PACKET_TASK_STACK_FREE,   /* bytes never used, high-water mark      */
+    STATS_LED_TASK_CPU_MS,
+    STATS_LED_TASK_STACK_FREE,
+    STATS_FRAMES_FILTERED,      /* addressed to other controllers             */
+    STATS_TIMED_PENDING,        /* schedules queued for a later activation    */
+    STATS_TIMED_DROPPED,        /* timed schedules refused, queue full        */
+    STATS_DETECTOR_CALLS,       /* detector edges seen by the EXTI callback   */
+    STATS_GREENS_EXTENDED,      /* actuated greens run past their planned time */
+    STATS_GREENS_CUT,           /* actuated greens ended before it            */
+    STATS_CLOCK_SETS,           /* PACKET_TIME_SET frames applied             */
+    STATS_CYCLE_PHASE_ERR_MS,   /* |cycle start - shared-clock target|, last  */
+    STATS_PREEMPTS,             /* PACKET_PREEMPT_START requests served       */
+    STATS_PREEMPTS_REFUSED,     /* Interrupt = 0, or a conflicting pattern    */
+    STATS_PREEMPT_REACT_MAX_US, /* preempt frame EOF to first clearance write */
+    STATS_FRAME_POOL_MIN_FREE,  /* fewest free frame buffers since boot       */
+    STATS_WAKEUPS,              /* tasks switched in after idle (power.h)     */
+    STATS_SLEEPS,               /* tickless sleeps, ISR-only wakes included   */
+    STATS_IDLE_MS,              /* time in the idle task                      */
+    STATS_CONFLICTS_REJECTED,   /* schedules failing the conflict check       */
+    STATS_CONFLICT_CACHE_HITS,  /* checks answered from cached verdicts       */
+    STATS_STORE_WRITES,         /* schedules written to flash since boot      */
+    STATS_STORE_ERASES,         /* flash sector erases since boot             */
+    STATS_STORE_SAVE_MAX_MS,    /* longest flash save                         */
+    STATS_BOOT_TO_LIGHT_MS,     /* HAL_Init to the first stage lit; 0: dark   */
+    STATS_STORE_ERASE_MAX_MS,   /* longest spare sector erase                 */
+    STATS_FIELD_COUNT
+} StatsField_t;
+
+#endif